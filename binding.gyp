@@ -1,8 +1,46 @@
 {
   "targets": [
+    {
+      "target_name": "render_core",
+      "type": "static_library",
+      "sources": [
+        "cplusplus/my_app.cpp",
+        "cplusplus/render_thread.cpp",
+        "cplusplus/render_cache.cpp",
+        "cplusplus/render_service.cpp",
+        "cplusplus/metrics.cpp",
+        "cplusplus/async_logger.cpp",
+        "cplusplus/tracer.cpp",
+        "cplusplus/png_stream.cpp",
+        "cplusplus/encoder_pool.cpp",
+        "cplusplus/resample.cpp",
+        "cplusplus/trim.cpp",
+        "cplusplus/apng.cpp",
+        "cplusplus/delta.cpp",
+        "cplusplus/surface_pool.cpp",
+        "cplusplus/engine_heap.cpp",
+        "cplusplus/memory_governor.cpp",
+        "cplusplus/network_policy.cpp"
+      ],
+      "include_dirs": [
+        "/app/cplusplus/lib/include"
+      ],
+      "cflags!": [ "-fno-exceptions" ],
+      "cflags_cc!": [ "-fno-exceptions" ],
+      "cflags": [
+        "-std=c++17",
+        "-fPIC"
+      ],
+      "cflags_cc": [
+        "-std=c++17"
+      ]
+    },
     {
       "target_name": "addon",
-      "sources": [ "cplusplus/main.cpp" ],
+      "sources": [
+        "cplusplus/main.cpp"
+      ],
+      "dependencies": [ "render_core" ],
       "include_dirs": [
         "<!@(node -p \"require('node-addon-api').include\")",
         "/app/cplusplus/lib/include"
@@ -11,7 +49,8 @@
         "/app/cplusplus/lib/bin/libAppCore.so",
         "/app/cplusplus/lib/bin/libUltralight.so",
         "/app/cplusplus/lib/bin/libUltralightCore.so",
-        "/app/cplusplus/lib/bin/libWebCore.so"
+        "/app/cplusplus/lib/bin/libWebCore.so",
+        "-lz"
       ],
       "cflags!": [ "-fno-exceptions" ],
       "cflags_cc!": [ "-fno-exceptions" ],
@@ -25,6 +64,129 @@
       "ldflags": [
         "-Wl,-rpath=./"
       ]
+    },
+    {
+      "target_name": "zygote",
+      "type": "executable",
+      "sources": [
+        "cplusplus/zygote.cpp",
+        "cplusplus/preload.cpp"
+      ],
+      "dependencies": [ "render_core" ],
+      "include_dirs": [
+        "/app/cplusplus/lib/include"
+      ],
+      "libraries": [
+        "/app/cplusplus/lib/bin/libAppCore.so",
+        "/app/cplusplus/lib/bin/libUltralight.so",
+        "/app/cplusplus/lib/bin/libUltralightCore.so",
+        "/app/cplusplus/lib/bin/libWebCore.so",
+        "-lpthread",
+        "-lz"
+      ],
+      "cflags!": [ "-fno-exceptions" ],
+      "cflags_cc!": [ "-fno-exceptions" ],
+      "cflags": [
+        "-std=c++17"
+      ],
+      "cflags_cc": [
+        "-std=c++17"
+      ],
+      "ldflags": [
+        "-Wl,-rpath=/app/cplusplus/lib/bin"
+      ]
+    },
+    {
+      "target_name": "bench",
+      "type": "executable",
+      "sources": [
+        "cplusplus/bench.cpp",
+        "cplusplus/bench_corpus.cpp"
+      ],
+      "dependencies": [ "render_core" ],
+      "include_dirs": [
+        "/app/cplusplus/lib/include"
+      ],
+      "libraries": [
+        "/app/cplusplus/lib/bin/libAppCore.so",
+        "/app/cplusplus/lib/bin/libUltralight.so",
+        "/app/cplusplus/lib/bin/libUltralightCore.so",
+        "/app/cplusplus/lib/bin/libWebCore.so",
+        "-lpthread",
+        "-lz"
+      ],
+      "cflags!": [ "-fno-exceptions" ],
+      "cflags_cc!": [ "-fno-exceptions" ],
+      "cflags": [
+        "-std=c++17"
+      ],
+      "cflags_cc": [
+        "-std=c++17"
+      ],
+      "ldflags": [
+        "-Wl,-rpath=/app/cplusplus/lib/bin"
+      ]
+    },
+    {
+      "target_name": "soak",
+      "type": "executable",
+      "sources": [
+        "cplusplus/soak.cpp",
+        "cplusplus/bench_corpus.cpp"
+      ],
+      "dependencies": [ "render_core" ],
+      "include_dirs": [
+        "/app/cplusplus/lib/include"
+      ],
+      "libraries": [
+        "/app/cplusplus/lib/bin/libAppCore.so",
+        "/app/cplusplus/lib/bin/libUltralight.so",
+        "/app/cplusplus/lib/bin/libUltralightCore.so",
+        "/app/cplusplus/lib/bin/libWebCore.so",
+        "-lpthread",
+        "-lz"
+      ],
+      "cflags!": [ "-fno-exceptions" ],
+      "cflags_cc!": [ "-fno-exceptions" ],
+      "cflags": [
+        "-std=c++17"
+      ],
+      "cflags_cc": [
+        "-std=c++17"
+      ],
+      "ldflags": [
+        "-Wl,-rpath=/app/cplusplus/lib/bin"
+      ]
+    },
+    {
+      "target_name": "netcheck",
+      "type": "executable",
+      "sources": [
+        "cplusplus/netcheck.cpp"
+      ],
+      "dependencies": [ "render_core" ],
+      "include_dirs": [
+        "/app/cplusplus/lib/include"
+      ],
+      "libraries": [
+        "/app/cplusplus/lib/bin/libAppCore.so",
+        "/app/cplusplus/lib/bin/libUltralight.so",
+        "/app/cplusplus/lib/bin/libUltralightCore.so",
+        "/app/cplusplus/lib/bin/libWebCore.so",
+        "-lpthread",
+        "-lz"
+      ],
+      "cflags!": [ "-fno-exceptions" ],
+      "cflags_cc!": [ "-fno-exceptions" ],
+      "cflags": [
+        "-std=c++17"
+      ],
+      "cflags_cc": [
+        "-std=c++17"
+      ],
+      "ldflags": [
+        "-Wl,-rpath=/app/cplusplus/lib/bin"
+      ]
     }
   ]
 }
@@ -0,0 +1,85 @@
+#include "apng.h"
+#include <stdexcept>
+#include <zlib.h>
+
+static void PutU32(uint8_t* out, uint32_t value) {
+  out[0] = (uint8_t)(value >> 24);
+  out[1] = (uint8_t)(value >> 16);
+  out[2] = (uint8_t)(value >> 8);
+  out[3] = (uint8_t)value;
+}
+
+static void PutU16(uint8_t* out, uint16_t value) {
+  out[0] = (uint8_t)(value >> 8);
+  out[1] = (uint8_t)value;
+}
+
+std::vector<uint8_t> CompressPngFrame(const uint8_t* pixels, uint32_t row_bytes, uint32_t width,
+                                      uint32_t height, bool alpha, int level) {
+  z_stream stream = {};
+  if (deflateInit(&stream, level) != Z_OK)
+    throw std::runtime_error("deflateInit failed");
+
+  PngRowFilter filter(width, alpha);
+  std::vector<uint8_t> out(deflateBound(&stream, (uLong)height * (width * (alpha ? 4 : 3) + 1)));
+  stream.next_out = out.data();
+  stream.avail_out = (uInt)out.size();
+
+  for (uint32_t y = 0; y < height; y++) {
+    const std::vector<uint8_t>& scanline = filter.Filter(pixels + (size_t)y * row_bytes);
+    stream.next_in = const_cast<Bytef*>(scanline.data());
+    stream.avail_in = (uInt)scanline.size();
+    deflate(&stream, Z_NO_FLUSH);
+  }
+
+  int result = deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  if (result != Z_STREAM_END)
+    throw std::runtime_error("deflate failed");
+  return out;
+}
+
+void WriteApng(uint32_t width, uint32_t height, bool alpha, uint32_t plays,
+               const std::vector<ApngFrame>& frames, const PngStreamEncoder::Sink& sink) {
+  if (frames.empty() || frames[0].x || frames[0].y || frames[0].width != width ||
+      frames[0].height != height)
+    throw std::runtime_error("The first APNG frame must cover the canvas");
+
+  WritePngHeader(sink, width, height, alpha);
+
+  uint8_t animation[8];
+  PutU32(animation, (uint32_t)frames.size());
+  PutU32(animation + 4, plays);
+  WritePngChunk(sink, "acTL", animation, sizeof(animation));
+
+  uint32_t sequence = 0;
+  std::vector<uint8_t> payload;
+  for (size_t i = 0; i < frames.size(); i++) {
+    const ApngFrame& frame = frames[i];
+
+    uint8_t control[26];
+    PutU32(control, sequence++);
+    PutU32(control + 4, frame.width);
+    PutU32(control + 8, frame.height);
+    PutU32(control + 12, frame.x);
+    PutU32(control + 16, frame.y);
+    PutU16(control + 20, frame.delay_num);
+    PutU16(control + 22, frame.delay_den);
+    control[24] = 0;             // dispose: none
+    control[25] = 0;             // blend: source
+    WritePngChunk(sink, "fcTL", control, sizeof(control));
+
+    // The first frame is the default image, so older decoders still read it.
+    if (i == 0) {
+      WritePngChunk(sink, "IDAT", frame.data.data(), frame.data.size());
+      continue;
+    }
+    payload.resize(4 + frame.data.size());
+    PutU32(payload.data(), sequence++);
+    std::copy(frame.data.begin(), frame.data.end(), payload.begin() + 4);
+    WritePngChunk(sink, "fdAT", payload.data(), payload.size());
+  }
+
+  WritePngChunk(sink, "IEND", nullptr, 0);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "png_stream.h"
+#include <cstdint>
+#include <vector>
+
+// One frame of an animated PNG. The first frame covers the whole canvas;
+// later frames replace the rectangle x, y, width, height and leave the rest
+// of the canvas as it was.
+struct ApngFrame {
+  uint32_t x = 0;
+  uint32_t y = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  // Shown for delay_num / delay_den seconds.
+  uint16_t delay_num = 1;
+  uint16_t delay_den = 10;
+  // Output of CompressPngFrame().
+  std::vector<uint8_t> data;
+};
+
+// Filters and deflates premultiplied BGRA rows into the image data of one
+// frame. Frames are independent zlib streams, so they can be compressed in
+// parallel and written in order afterwards.
+std::vector<uint8_t> CompressPngFrame(const uint8_t* pixels, uint32_t row_bytes, uint32_t width,
+                                      uint32_t height, bool alpha, int level);
+
+// Writes a complete APNG. Decoders without APNG support show the first frame.
+// `plays` of 0 loops forever.
+void WriteApng(uint32_t width, uint32_t height, bool alpha, uint32_t plays,
+               const std::vector<ApngFrame>& frames, const PngStreamEncoder::Sink& sink);
@@ -0,0 +1,134 @@
+#include "async_logger.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+using ultralight::LogLevel;
+
+static const char* LevelName(LogLevel level) {
+  switch (level) {
+    case LogLevel::Error: return "error";
+    case LogLevel::Warning: return "warning";
+    case LogLevel::Info: return "info";
+  }
+  return "info";
+}
+
+AsyncLogger& AsyncLogger::instance() {
+  static AsyncLogger logger;
+  return logger;
+}
+
+AsyncLogger::AsyncLogger() : slots_(new std::array<Slot, kCapacity>()) {
+  for (size_t i = 0; i < kCapacity; i++)
+    (*slots_)[i].sequence.store(i, std::memory_order_relaxed);
+  thread_ = std::thread([this] { Loop(); });
+}
+
+AsyncLogger::~AsyncLogger() {
+  stop_.store(true, std::memory_order_release);
+  if (thread_.joinable())
+    thread_.join();
+}
+
+bool AsyncLogger::ParseLevel(const std::string& name, int* level) {
+  if (name == "off")
+    *level = -1;
+  else if (name == "error")
+    *level = (int)LogLevel::Error;
+  else if (name == "warning" || name == "warn")
+    *level = (int)LogLevel::Warning;
+  else if (name == "info")
+    *level = (int)LogLevel::Info;
+  else
+    return false;
+  return true;
+}
+
+LogContext& AsyncLogger::context() {
+  thread_local LogContext context;
+  return context;
+}
+
+void AsyncLogger::Log(LogLevel level, const char* message, size_t length) {
+  if (!enabled(level))
+    return;
+
+  uint64_t position = head_.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;) {
+    slot = &(*slots_)[position & (kCapacity - 1)];
+    uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    int64_t diff = (int64_t)sequence - (int64_t)position;
+    if (diff == 0) {
+      if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      position = head_.load(std::memory_order_relaxed);
+    }
+  }
+
+  if (length > kMaxMessage) {
+    length = kMaxMessage;
+    truncated_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  const LogContext& ctx = context();
+  slot->level = level;
+  slot->job = ctx.job;
+  slot->phase = ctx.phase;
+  slot->length = (uint32_t)length;
+  memcpy(slot->text, message, length);
+  slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+size_t AsyncLogger::Drain(std::string& out) {
+  size_t count = 0;
+  char prefix[96];
+  for (;;) {
+    Slot& slot = (*slots_)[tail_ & (kCapacity - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != tail_ + 1)
+      break;
+
+    int n = snprintf(prefix, sizeof(prefix), "> %s", LevelName(slot.level));
+    out.append(prefix, n);
+    if (slot.job) {
+      n = snprintf(prefix, sizeof(prefix), " job=%llu", (unsigned long long)slot.job);
+      out.append(prefix, n);
+    }
+    if (slot.phase) {
+      out += " phase=";
+      out += slot.phase;
+    }
+    out += ' ';
+    out.append(slot.text, slot.length);
+    out += '\n';
+
+    slot.sequence.store(tail_ + kCapacity, std::memory_order_release);
+    tail_++;
+    count++;
+  }
+  return count;
+}
+
+void AsyncLogger::Loop() {
+  std::string out;
+  for (;;) {
+    bool stopping = stop_.load(std::memory_order_acquire);
+
+    out.clear();
+    size_t count = Drain(out);
+    if (!out.empty()) {
+      fwrite(out.data(), 1, out.size(), stdout);
+      fflush(stdout);
+    }
+
+    if (stopping)
+      break;
+    if (count == 0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+}
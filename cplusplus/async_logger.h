@@ -0,0 +1,82 @@
+#pragma once
+#include <Ultralight/platform/Logger.h>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Per-thread fields attached to every message logged from that thread.
+struct LogContext {
+  uint64_t job = 0;
+  const char* phase = nullptr;
+};
+
+// Bounded lock-free ring buffer (Vyukov MPMC slots, single consumer) drained
+// to stdout by a background thread. Logging is a level check, one CAS and a
+// memcpy; when the buffer is full the message is dropped and counted rather
+// than blocking the caller.
+class AsyncLogger {
+public:
+  static const size_t kCapacity = 4096;
+  static const size_t kMaxMessage = 480;
+
+  static AsyncLogger& instance();
+
+  bool enabled(ultralight::LogLevel level) const {
+    return (int)level <= max_level_.load(std::memory_order_relaxed);
+  }
+
+  // Messages above `level` are discarded before they are copied. -1 turns
+  // logging off entirely.
+  void set_level(int level) { max_level_.store(level, std::memory_order_relaxed); }
+  static bool ParseLevel(const std::string& name, int* level);
+
+  void Log(ultralight::LogLevel level, const char* message, size_t length);
+  void Log(ultralight::LogLevel level, const std::string& message) {
+    Log(level, message.data(), message.size());
+  }
+
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+  uint64_t truncated() const { return truncated_.load(std::memory_order_relaxed); }
+
+  static LogContext& context();
+  static void SetPhase(const char* phase) { context().phase = phase; }
+
+  // Tags messages from this thread with `job` until the scope ends.
+  class JobScope {
+  public:
+    explicit JobScope(uint64_t job) : previous_(context()) { context() = LogContext{job, nullptr}; }
+    ~JobScope() { context() = previous_; }
+
+  private:
+    LogContext previous_;
+  };
+
+private:
+  AsyncLogger();
+  ~AsyncLogger();
+
+  struct Slot {
+    std::atomic<uint64_t> sequence{0};
+    ultralight::LogLevel level;
+    uint64_t job;
+    const char* phase;
+    uint32_t length;
+    char text[kMaxMessage];
+  };
+
+  size_t Drain(std::string& out);
+  void Loop();
+
+  std::unique_ptr<std::array<Slot, kCapacity>> slots_;
+  alignas(64) std::atomic<uint64_t> head_{0};
+  alignas(64) uint64_t tail_ = 0;
+  std::atomic<int> max_level_{(int)ultralight::LogLevel::Info};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> truncated_{0};
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
@@ -0,0 +1,281 @@
+// Render benchmark. Runs every case in the corpus manifest through the same
+// ProcessRenderRequest() path the addon uses (with the result cache off) and
+// reports throughput, per-phase latency percentiles and peak RSS.
+//
+//   bench [--corpus DIR] [--iterations N] [--warmup N] [--concurrency N]
+//         [--filter NAME] [--json FILE|-] [--label TEXT]
+//
+// Run from the directory that contains assets/, like the addon.
+
+#include "async_logger.h"
+#include "bench_corpus.h"
+#include "render_service.h"
+#include "render_thread.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+struct BenchOptions {
+  std::string corpus = "cplusplus/bench/corpus";
+  uint32_t iterations = 20;
+  uint32_t warmup = 3;
+  uint32_t concurrency = 1;
+  std::string filter;
+  std::string json;
+  std::string label;
+};
+
+static const char* kPhases[] = { "queue", "load", "paint", "encode", "total" };
+static const size_t kPhaseCount = sizeof(kPhases) / sizeof(kPhases[0]);
+
+struct PhaseStats {
+  double mean = 0, p50 = 0, p95 = 0, p99 = 0, max = 0;
+};
+
+struct CaseResult {
+  const BenchCase* bench_case = nullptr;
+  uint32_t renders = 0;
+  uint32_t failures = 0;
+  double wall_seconds = 0;
+  size_t png_bytes = 0;
+  PhaseStats phases[kPhaseCount];
+  size_t peak_rss_bytes = 0;
+};
+
+static size_t PeakRssBytes() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (size_t)usage.ru_maxrss * 1024;
+}
+
+static PhaseStats Summarize(std::vector<double>& samples) {
+  PhaseStats stats;
+  if (samples.empty())
+    return stats;
+
+  std::sort(samples.begin(), samples.end());
+  auto rank = [&](double q) { return samples[std::min(samples.size() - 1, (size_t)(q * samples.size()))]; };
+  double sum = 0;
+  for (double sample : samples)
+    sum += sample;
+
+  stats.mean = sum / samples.size();
+  stats.p50 = rank(0.50);
+  stats.p95 = rank(0.95);
+  stats.p99 = rank(0.99);
+  stats.max = samples.back();
+  return stats;
+}
+
+static RenderRequest MakeRequest(const BenchCase& bench_case) {
+  RenderRequest request;
+  request.html = bench_case.html;
+  request.width = bench_case.width;
+  request.height = bench_case.height;
+  request.with_images = !bench_case.images.empty();
+  request.imagePaths = bench_case.images;
+  request.use_cache = false;
+  return request;
+}
+
+static CaseResult RunCase(const BenchCase& bench_case, const BenchOptions& options) {
+  CaseResult result;
+  result.bench_case = &bench_case;
+  RenderRequest request = MakeRequest(bench_case);
+
+  for (uint32_t i = 0; i < options.warmup; i++)
+    ProcessRenderRequest(request);
+
+  std::vector<RenderTimings> timings(options.iterations);
+  std::vector<char> ok(options.iterations, 0);
+  std::atomic<uint32_t> next{0};
+  std::atomic<size_t> png_bytes{0};
+
+  auto started = std::chrono::steady_clock::now();
+  std::vector<std::thread> clients;
+  for (uint32_t c = 0; c < std::max<uint32_t>(options.concurrency, 1); c++) {
+    clients.emplace_back([&] {
+      for (uint32_t i = next++; i < options.iterations; i = next++) {
+        try {
+          RenderResponse response = ProcessRenderRequest(request);
+          timings[i] = response.timings;
+          ok[i] = response.png != nullptr;
+          if (response.png)
+            png_bytes.store(response.png->size(), std::memory_order_relaxed);
+        } catch (const std::exception& e) {
+          std::cerr << "> " << bench_case.name << ": " << e.what() << std::endl;
+        }
+      }
+    });
+  }
+  for (auto& client : clients)
+    client.join();
+  result.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  std::vector<double> samples[kPhaseCount];
+  for (uint32_t i = 0; i < options.iterations; i++) {
+    if (!ok[i]) {
+      result.failures++;
+      continue;
+    }
+    const RenderTimings& t = timings[i];
+    result.renders++;
+    samples[0].push_back(RenderTimings::Between(t.enqueued, t.started));
+    samples[1].push_back(RenderTimings::Between(t.load_begin, t.load_end));
+    samples[2].push_back(RenderTimings::Between(t.paint_begin, t.paint_end));
+    samples[3].push_back(RenderTimings::Between(t.encode_begin, t.encode_end));
+    samples[4].push_back(RenderTimings::Between(t.enqueued, t.encode_end));
+  }
+  for (size_t p = 0; p < kPhaseCount; p++)
+    result.phases[p] = Summarize(samples[p]);
+
+  result.png_bytes = png_bytes.load();
+  result.peak_rss_bytes = PeakRssBytes();
+  return result;
+}
+
+static void PrintTable(FILE* out, const std::vector<CaseResult>& results) {
+  fprintf(out, "%-10s %7s %8s", "case", "renders", "rps");
+  for (const char* phase : kPhases)
+    fprintf(out, " %8s-p50 %6s-p99", phase, phase);
+  fprintf(out, " %9s\n", "rss-MiB");
+
+  for (const CaseResult& r : results) {
+    fprintf(out, "%-10s %7u %8.2f", r.bench_case->name.c_str(), r.renders,
+                r.wall_seconds > 0 ? r.renders / r.wall_seconds : 0.0);
+    for (size_t p = 0; p < kPhaseCount; p++)
+      fprintf(out, " %12.2f %10.2f", r.phases[p].p50, r.phases[p].p99);
+    fprintf(out, " %9.1f\n", r.peak_rss_bytes / (1024.0 * 1024.0));
+  }
+}
+
+static std::string ToJson(const std::vector<CaseResult>& results, const BenchOptions& options,
+                          double wall_seconds) {
+  std::ostringstream out;
+  uint32_t total_renders = 0;
+  for (const CaseResult& r : results)
+    total_renders += r.renders;
+
+  out << "{\n  \"label\": \"" << JsonEscape(options.label) << "\",\n"
+      << "  \"timestamp\": " << (long long)time(nullptr) << ",\n"
+      << "  \"iterations\": " << options.iterations << ",\n"
+      << "  \"concurrency\": " << options.concurrency << ",\n"
+      << "  \"throughput_rps\": " << (wall_seconds > 0 ? total_renders / wall_seconds : 0.0) << ",\n"
+      << "  \"peak_rss_bytes\": " << PeakRssBytes() << ",\n"
+      << "  \"cases\": [";
+
+  for (size_t i = 0; i < results.size(); i++) {
+    const CaseResult& r = results[i];
+    out << (i ? "," : "") << "\n    {\n"
+        << "      \"name\": \"" << JsonEscape(r.bench_case->name) << "\",\n"
+        << "      \"width\": " << r.bench_case->width << ",\n"
+        << "      \"height\": " << r.bench_case->height << ",\n"
+        << "      \"renders\": " << r.renders << ",\n"
+        << "      \"failures\": " << r.failures << ",\n"
+        << "      \"throughput_rps\": " << (r.wall_seconds > 0 ? r.renders / r.wall_seconds : 0.0) << ",\n"
+        << "      \"png_bytes\": " << r.png_bytes << ",\n"
+        << "      \"peak_rss_bytes\": " << r.peak_rss_bytes << ",\n"
+        << "      \"phases_ms\": {";
+    for (size_t p = 0; p < kPhaseCount; p++) {
+      const PhaseStats& s = r.phases[p];
+      out << (p ? "," : "") << "\n        \"" << kPhases[p] << "\": { \"mean\": " << s.mean
+          << ", \"p50\": " << s.p50 << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99
+          << ", \"max\": " << s.max << " }";
+    }
+    out << "\n      }\n    }";
+  }
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+static bool ParseArgs(int argc, char** argv, BenchOptions* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "> Missing value for " << arg << std::endl;
+      return false;
+    }
+    const char* value = argv[++i];
+    if (arg == "--corpus")
+      options->corpus = value;
+    else if (arg == "--iterations")
+      options->iterations = strtoul(value, nullptr, 10);
+    else if (arg == "--warmup")
+      options->warmup = strtoul(value, nullptr, 10);
+    else if (arg == "--concurrency")
+      options->concurrency = strtoul(value, nullptr, 10);
+    else if (arg == "--filter")
+      options->filter = value;
+    else if (arg == "--json")
+      options->json = value;
+    else if (arg == "--label")
+      options->label = value;
+    else {
+      std::cerr << "> Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  if (!ParseArgs(argc, argv, &options))
+    return 2;
+
+  std::vector<BenchCase> cases;
+  if (!LoadCorpus(options.corpus, options.filter, &cases))
+    return 1;
+  if (cases.empty()) {
+    std::cerr << "> No benchmark cases matched" << std::endl;
+    return 1;
+  }
+
+  AsyncLogger::instance().set_level((int)ultralight::LogLevel::Error);
+
+  PlatformOptions platform_options;
+  platform_options.memory = MemoryBudget::FromEnvironment();
+  MyApp::set_platform_options(platform_options);
+
+  auto warmup_started = std::chrono::steady_clock::now();
+  RenderThread::instance().Post([](MyApp& app) { app.Warmup(WarmupOptions()); }).get();
+  std::cerr << "> Warm-up took "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - warmup_started).count()
+            << " ms" << std::endl;
+
+  std::vector<CaseResult> results;
+  auto started = std::chrono::steady_clock::now();
+  for (const BenchCase& bench_case : cases)
+    results.push_back(RunCase(bench_case, options));
+  double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+  // Keep stdout clean for the JSON when it is written there.
+  PrintTable(options.json == "-" ? stderr : stdout, results);
+
+  if (!options.json.empty()) {
+    std::string json = ToJson(results, options, wall_seconds);
+    if (options.json == "-") {
+      fwrite(json.data(), 1, json.size(), stdout);
+    } else {
+      std::ofstream file(options.json);
+      file << json;
+    }
+  }
+
+  for (const CaseResult& r : results) {
+    if (r.failures)
+      return 1;
+  }
+  return 0;
+}
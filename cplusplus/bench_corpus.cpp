@@ -0,0 +1,69 @@
+#include "bench_corpus.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static bool ReadFile(const std::string& path, std::string* out) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+  std::stringstream ss;
+  ss << file.rdbuf();
+  *out = ss.str();
+  return true;
+}
+
+bool LoadCorpus(const std::string& dir, const std::string& filter, std::vector<BenchCase>* cases) {
+  std::ifstream manifest(dir + "/manifest.txt");
+  if (!manifest) {
+    std::cerr << "> Cannot open " << dir << "/manifest.txt" << std::endl;
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(manifest, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::istringstream fields(line);
+    BenchCase bench_case;
+    std::string file;
+    if (!(fields >> bench_case.name >> file >> bench_case.width >> bench_case.height))
+      continue;
+    if (!filter.empty() && bench_case.name.find(filter) == std::string::npos)
+      continue;
+
+    if (!ReadFile(dir + "/" + file, &bench_case.html)) {
+      std::cerr << "> Cannot read " << file << std::endl;
+      return false;
+    }
+
+    std::string image;
+    while (fields >> image) {
+      size_t eq = image.find('=');
+      if (eq != std::string::npos)
+        bench_case.images[image.substr(0, eq)] = dir + "/" + image.substr(eq + 1);
+    }
+
+    cases->push_back(std::move(bench_case));
+  }
+  return true;
+}
+
+std::string JsonEscape(const std::string& value) {
+  std::string out;
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if ((unsigned char)c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Benchmark corpus shared by the bench and soak executables. manifest.txt
+// lists one case per line as `name file width height [image=file ...]`.
+struct BenchCase {
+  std::string name;
+  std::string html;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::map<std::string, std::string> images;
+};
+
+// Loads the cases whose name contains `filter` (all if empty).
+bool LoadCorpus(const std::string& dir, const std::string& filter, std::vector<BenchCase>* cases);
+
+std::string JsonEscape(const std::string& value);
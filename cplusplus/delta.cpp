@@ -0,0 +1,67 @@
+#include "delta.h"
+#include <algorithm>
+#include <cstring>
+
+// Index of the first pixel in [begin, end) that differs, or end.
+static uint32_t FirstDifference(const uint32_t* a, const uint32_t* b, uint32_t begin, uint32_t end) {
+  while (begin < end && a[begin] == b[begin])
+    begin++;
+  return begin;
+}
+
+// One past the last pixel in [begin, end) that differs, or begin.
+static uint32_t LastDifference(const uint32_t* a, const uint32_t* b, uint32_t begin, uint32_t end) {
+  while (end > begin && a[end - 1] == b[end - 1])
+    end--;
+  return end;
+}
+
+std::vector<PixelRect> FindChangedRects(const uint8_t* current, uint32_t current_row_bytes,
+                                        const uint8_t* previous, uint32_t previous_row_bytes,
+                                        PixelRect bounds, uint32_t merge_rows) {
+  std::vector<PixelRect> rects;
+  if (!bounds.width || !bounds.height)
+    return rects;
+
+  auto row = [&](const uint8_t* frame, uint32_t row_bytes, uint32_t y) {
+    return reinterpret_cast<const uint32_t*>(frame + (size_t)(bounds.y + y) * row_bytes) + bounds.x;
+  };
+  size_t row_size = (size_t)bounds.width * 4;
+  auto changed = [&](uint32_t y) {
+    return memcmp(row(current, current_row_bytes, y), row(previous, previous_row_bytes, y), row_size) != 0;
+  };
+
+  uint32_t y = 0;
+  while (y < bounds.height) {
+    while (y < bounds.height && !changed(y))
+      y++;
+    if (y == bounds.height)
+      break;
+
+    uint32_t top = y;
+    uint32_t bottom = ++y;
+    while (y < bounds.height && y - bottom < merge_rows) {
+      if (changed(y))
+        bottom = y + 1;
+      y++;
+    }
+
+    // Each row only needs to be searched up to the edges found so far.
+    uint32_t left = bounds.width;
+    uint32_t right = 0;
+    for (uint32_t r = top; r < bottom; r++) {
+      const uint32_t* a = row(current, current_row_bytes, r);
+      const uint32_t* b = row(previous, previous_row_bytes, r);
+      left = FirstDifference(a, b, 0, left);
+      right = LastDifference(a, b, right, bounds.width);
+    }
+
+    PixelRect rect;
+    rect.x = bounds.x + left;
+    rect.y = bounds.y + top;
+    rect.width = right - left;
+    rect.height = bottom - top;
+    rects.push_back(rect);
+  }
+  return rects;
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include "pixel_rect.h"
+#include <cstdint>
+#include <vector>
+
+// Finds the parts of `bounds` where two BGRA frames of the same size differ.
+// Rows are compared whole, changed rows separated by fewer than `merge_rows`
+// unchanged ones are joined into one band, and each band is narrowed to its
+// changed columns. Returns the bands top to bottom; none if nothing differs.
+std::vector<PixelRect> FindChangedRects(const uint8_t* current, uint32_t current_row_bytes,
+                                        const uint8_t* previous, uint32_t previous_row_bytes,
+                                        PixelRect bounds, uint32_t merge_rows = 16);
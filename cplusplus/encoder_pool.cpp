@@ -0,0 +1,75 @@
+#include "encoder_pool.h"
+#include "async_logger.h"
+#include "tracer.h"
+#include <algorithm>
+#include <memory>
+
+EncoderPool& EncoderPool::instance() {
+  static EncoderPool pool;
+  return pool;
+}
+
+EncoderPool::~EncoderPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& thread : threads_)
+    thread.join();
+}
+
+void EncoderPool::Loop() {
+  Tracer::instance().SetThreadName("encoder");
+
+  for (;;) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+      if (stop_ && jobs_.empty())
+        return;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    job();
+  }
+}
+
+std::future<void> EncoderPool::Submit(std::function<void()> task) {
+  uint64_t job = AsyncLogger::context().job;
+  auto packaged = std::make_shared<std::packaged_task<void()>>([job, task = std::move(task)] {
+    AsyncLogger::JobScope scope(job);
+    task();
+  });
+  std::future<void> result = packaged->get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (threads_.empty()) {
+      unsigned count = std::min(kMaxThreads, std::max(1u, std::thread::hardware_concurrency()));
+      for (unsigned i = 0; i < count; i++)
+        threads_.emplace_back([this] { Loop(); });
+    }
+    jobs_.push_back([packaged] { (*packaged)(); });
+  }
+  cv_.notify_one();
+  return result;
+}
+
+void EncoderPool::RunAll(std::vector<std::function<void()>> tasks) {
+  if (tasks.size() == 1) {
+    tasks[0]();
+    return;
+  }
+
+  std::vector<std::future<void>> results;
+  for (auto& task : tasks)
+    results.push_back(Submit(std::move(task)));
+
+  // Wait for every task before rethrowing, since they reference the
+  // caller's buffers.
+  for (auto& result : results)
+    result.wait();
+  for (auto& result : results)
+    result.get();
+}
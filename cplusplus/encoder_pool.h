@@ -0,0 +1,39 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for CPU work that does not touch the engine,
+// such as resampling and PNG encoding, so it can run off the RenderThread and
+// in parallel. Threads are started on first use, which keeps a zygote parent
+// that never renders single-threaded before it forks.
+class EncoderPool {
+public:
+  static const unsigned kMaxThreads = 4;
+
+  static EncoderPool& instance();
+
+  // Queues `task` and returns at once. Its log lines and trace events carry
+  // the caller's job id.
+  std::future<void> Submit(std::function<void()> task);
+
+  // Runs every task on the pool and blocks until all of them have finished.
+  // Rethrows the first exception thrown by a task.
+  void RunAll(std::vector<std::function<void()>> tasks);
+
+private:
+  EncoderPool() = default;
+  ~EncoderPool();
+
+  void Loop();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> jobs_;
+  std::vector<std::thread> threads_;
+  bool stop_ = false;
+};
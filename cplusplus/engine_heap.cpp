@@ -0,0 +1,164 @@
+#include "engine_heap.h"
+#include "metrics.h"
+#include <Ultralight/platform/Allocator.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+
+#pragma weak ulAllocator
+
+static std::atomic<bool> g_installed{false};
+// Signed, since blocks allocated before Install() may be freed through it.
+static std::atomic<int64_t> g_live{0};
+static std::atomic<uint64_t> g_allocated{0};
+static std::atomic<int64_t> g_peak{0};
+
+// Only touched from the RenderThread.
+static RenderTimings* g_timings = nullptr;
+static uint64_t RenderTimings::*g_phase_peak = nullptr;
+static uint64_t g_job_start = 0;
+
+static void Track(void* address) {
+  if (!address)
+    return;
+  int64_t size = (int64_t)malloc_usable_size(address);
+  g_allocated.fetch_add(size, std::memory_order_relaxed);
+  int64_t live = g_live.fetch_add(size, std::memory_order_relaxed) + size;
+  int64_t peak = g_peak.load(std::memory_order_relaxed);
+  while (live > peak && !g_peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+  }
+}
+
+static void Untrack(void* address) {
+  if (address)
+    g_live.fetch_sub((int64_t)malloc_usable_size(address), std::memory_order_relaxed);
+}
+
+static void* HeapMalloc(size_t bytes) {
+  void* address = malloc(bytes);
+  Track(address);
+  return address;
+}
+
+static void* HeapRealloc(void* address, size_t bytes) {
+  size_t old_size = address ? malloc_usable_size(address) : 0;
+  void* result = realloc(address, bytes);
+  if (result || !bytes) {
+    g_live.fetch_sub((int64_t)old_size, std::memory_order_relaxed);
+    Track(result);
+  }
+  return result;
+}
+
+static void HeapFree(void* address) {
+  Untrack(address);
+  free(address);
+}
+
+static void* HeapAlignedMalloc(size_t bytes, size_t alignment) {
+  void* address = nullptr;
+  if (posix_memalign(&address, std::max(alignment, sizeof(void*)), bytes) != 0)
+    return nullptr;
+  Track(address);
+  return address;
+}
+
+// There is no aligned realloc in libc, so move the block.
+static void* HeapAlignedRealloc(void* address, size_t bytes, size_t alignment) {
+  if (!address)
+    return HeapAlignedMalloc(bytes, alignment);
+  void* result = HeapAlignedMalloc(bytes, alignment);
+  if (!result)
+    return nullptr;
+  memcpy(result, address, std::min(bytes, malloc_usable_size(address)));
+  HeapFree(address);
+  return result;
+}
+
+static size_t HeapSizeEstimate(void* address) {
+  return malloc_usable_size(address);
+}
+
+bool EngineHeap::Install() {
+  if (!&ulAllocator)
+    return false;
+  ulAllocator.malloc = HeapMalloc;
+  ulAllocator.realloc = HeapRealloc;
+  ulAllocator.free = HeapFree;
+  ulAllocator.aligned_malloc = HeapAlignedMalloc;
+  ulAllocator.aligned_realloc = HeapAlignedRealloc;
+  ulAllocator.aligned_free = HeapFree;
+  ulAllocator.get_size_estimate = HeapSizeEstimate;
+  g_installed.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+bool EngineHeap::installed() {
+  return g_installed.load(std::memory_order_relaxed);
+}
+
+uint64_t EngineHeap::live_bytes() {
+  return (uint64_t)std::max<int64_t>(0, g_live.load(std::memory_order_relaxed));
+}
+
+uint64_t EngineHeap::allocated_bytes() {
+  return g_allocated.load(std::memory_order_relaxed);
+}
+
+static void ClosePhase() {
+  if (g_timings && g_phase_peak)
+    g_timings->*g_phase_peak =
+        std::max(g_timings->*g_phase_peak, (uint64_t)std::max<int64_t>(0, g_peak.load(std::memory_order_relaxed)));
+  g_phase_peak = nullptr;
+}
+
+void EngineHeap::BeginJob(RenderTimings* timings) {
+  g_timings = timings;
+  g_phase_peak = nullptr;
+  g_job_start = allocated_bytes();
+}
+
+void EngineHeap::BeginPhase(uint64_t RenderTimings::*peak) {
+  if (!g_timings || !installed())
+    return;
+  ClosePhase();
+  g_peak.store(g_live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  g_phase_peak = peak;
+}
+
+void EngineHeap::EndJob() {
+  if (!g_timings)
+    return;
+  ClosePhase();
+  g_timings->heap_allocated_bytes = allocated_bytes() - g_job_start;
+  g_timings = nullptr;
+}
+
+void EngineHeap::SampleFragmentation(uint64_t trim_threshold) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+  struct mallinfo2 info = mallinfo2();
+  uint64_t arena = info.arena + info.hblkhd;
+  uint64_t free_bytes = info.fordblks;
+#else
+  // The int fields wrap past 4 GB; read them as unsigned.
+  struct mallinfo info = mallinfo();
+  uint64_t arena = (uint64_t)(unsigned)info.arena + (unsigned)info.hblkhd;
+  uint64_t free_bytes = (unsigned)info.fordblks;
+#endif
+
+  Metrics& metrics = Metrics::instance();
+  metrics.malloc_arena_bytes.store(arena, std::memory_order_relaxed);
+  metrics.malloc_free_bytes.store(free_bytes, std::memory_order_relaxed);
+  metrics.engine_heap_live_bytes.store(live_bytes(), std::memory_order_relaxed);
+  metrics.engine_heap_allocated_bytes.store(allocated_bytes(), std::memory_order_relaxed);
+
+  if (trim_threshold && free_bytes > trim_threshold)
+    TrimMalloc();
+}
+
+void EngineHeap::TrimMalloc() {
+  if (malloc_trim(0))
+    Metrics::instance().malloc_trims.fetch_add(1, std::memory_order_relaxed);
+}
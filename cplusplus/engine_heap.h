@@ -0,0 +1,34 @@
+#pragma once
+#include "timings.h"
+#include <cstdint>
+
+// Routes the engine's allocations through the ulAllocator hooks so they can
+// be counted. The backend stays the process malloc, whose thread caches and
+// size-class bins already suit the engine; the hooks add byte accounting per
+// job and per phase. ulAllocator only exists in engine builds with
+// UL_ENABLE_ALLOCATOR_OVERRIDE, so it is looked up weakly and Install()
+// returns false without it, leaving the heap counters at zero.
+class EngineHeap {
+public:
+  // Must run before the first engine call.
+  static bool Install();
+  static bool installed();
+
+  static uint64_t live_bytes();
+  static uint64_t allocated_bytes();
+
+  // Attributes heap use to `timings` until EndJob(). Render jobs run one at a
+  // time on the RenderThread, so the process-wide counters are the job's.
+  static void BeginJob(RenderTimings* timings);
+  // Starts recording the heap's high-water mark into `peak` of the job.
+  static void BeginPhase(uint64_t RenderTimings::*peak);
+  static void EndJob();
+
+  // Reads the process malloc's arena statistics into the metrics and hands
+  // free arena memory back to the OS once more than `trim_threshold` bytes
+  // of it are unused. Fragmentation that used to show up as RSS creep shows
+  // up as a growing free-bytes gauge instead.
+  static void SampleFragmentation(uint64_t trim_threshold);
+  // Hands all free arena memory back to the OS.
+  static void TrimMalloc();
+};
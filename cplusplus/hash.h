@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Fast non-cryptographic 64-bit hash (wyhash construction). Used for cache
+// keys, where it runs over whole HTML documents at memory bandwidth.
+
+inline uint64_t HashMix(uint64_t a, uint64_t b) {
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+inline uint64_t HashRead64(const uint8_t* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t HashRead32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t Hash64(const void* data, size_t length, uint64_t seed) {
+  static const uint64_t s0 = 0xa0761d6478bd642full;
+  static const uint64_t s1 = 0xe7037ed1a0b428dbull;
+  static const uint64_t s2 = 0x8ebc6af09c88c6e3ull;
+  static const uint64_t s3 = 0x589965cc75374cc3ull;
+
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  seed ^= HashMix(seed ^ s0, s1);
+
+  uint64_t a, b;
+  if (length <= 16) {
+    if (length >= 4) {
+      size_t offset = (length >> 3) << 2;
+      a = (HashRead32(p) << 32) | HashRead32(p + offset);
+      b = (HashRead32(p + length - 4) << 32) | HashRead32(p + length - 4 - offset);
+    } else if (length > 0) {
+      a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = length;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = HashMix(HashRead64(p) ^ s1, HashRead64(p + 8) ^ seed);
+        see1 = HashMix(HashRead64(p + 16) ^ s2, HashRead64(p + 24) ^ see1);
+        see2 = HashMix(HashRead64(p + 32) ^ s3, HashRead64(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = HashMix(HashRead64(p) ^ s1, HashRead64(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = HashRead64(p + i - 16);
+    b = HashRead64(p + i - 8);
+  }
+
+  a ^= s1;
+  b ^= seed;
+  __uint128_t r = (__uint128_t)a * b;
+  a = (uint64_t)r;
+  b = (uint64_t)(r >> 64);
+  return HashMix(a ^ s0 ^ length, b ^ s1);
+}
@@ -1,331 +1,1030 @@
 #include <napi.h>
-#include <Ultralight/Ultralight.h>
-#include <AppCore/AppCore.h>
-#include <iostream>
-#include <filesystem>
-#include <fstream>
-#include <string>
-#include <memory>
-#include <thread>
+#include "async_logger.h"
+#include "engine_heap.h"
+#include "metrics.h"
+#include "render_service.h"
+#include "render_thread.h"
+#include "tracer.h"
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <string>
 #include <map>
+#include <memory>
+#include <mutex>
 
 using namespace ultralight;
 
-class MyApp : public LoadListener,
-              public ViewListener,
-              public Logger {
+static std::string ErrorMessage(const std::exception_ptr& error) {
+  try {
+    std::rethrow_exception(error);
+  } catch (const std::exception& e) {
+    return e.what();
+  } catch (...) {
+    return "Unknown error";
+  }
+}
+
+// A promise that any thread can settle, exactly once. Settling releases a
+// thread-safe function whose finalizer resolves or rejects the promise on the
+// JavaScript thread, so work that finishes on the RenderThread does not need
+// a threadpool thread parked waiting for it. Copies share the same promise.
+class PendingPromise {
+public:
+  using Resolver = std::function<Napi::Value(Napi::Env)>;
+
+  explicit PendingPromise(Napi::Env env) : state_(new State(env)) {
+    settle_ = Napi::ThreadSafeFunction::New(env, Napi::Function::New(env, [](const Napi::CallbackInfo&) {}),
+                                            "settle", 0, 1, state_, [](Napi::Env env, State* state) {
+                                              if (state->failed)
+                                                state->deferred.Reject(Napi::Error::New(env, state->error).Value());
+                                              else
+                                                state->deferred.Resolve(state->resolve(env));
+                                              delete state;
+                                            });
+  }
+
+  // Only valid on the JavaScript thread, before the promise is settled.
+  Napi::Promise Promise() const { return state_->deferred.Promise(); }
+
+  void Resolve(Resolver resolve) const {
+    state_->resolve = std::move(resolve);
+    settle_.Release();
+  }
+
+  void Reject(std::string error) const {
+    state_->error = std::move(error);
+    state_->failed = true;
+    settle_.Release();
+  }
+
+  void Reject(const std::exception_ptr& error) const { Reject(ErrorMessage(error)); }
+
 private:
-  RefPtr<Renderer> renderer_;
-  RefPtr<View> view_;
-  bool done_ = false;
-  std::map<std::string, std::string> imagePaths_;
-  bool useLocalImages_ = false;
+  struct State {
+    explicit State(Napi::Env env) : deferred(Napi::Promise::Deferred::New(env)) {}
 
-  MyApp() {
-    std::string app_path = std::filesystem::current_path().string();
-    LogMessage(LogLevel::Info, "App Path: " + ultralight::String(app_path.c_str()));
+    Napi::Promise::Deferred deferred;
+    Resolver resolve;
+    std::string error;
+    bool failed = false;
+  };
 
-    Config config;
+  State* state_;
+  Napi::ThreadSafeFunction settle_;
+};
 
-    Platform::instance().set_config(config);
-    Platform::instance().set_font_loader(GetPlatformFontLoader());
-    Platform::instance().set_file_system(GetPlatformFileSystem("./assets/"));
-    Platform::instance().set_logger(this);
+// Runs `job` on the RenderThread and settles the promise with the resolver
+// it returns, or rejects it with what it threw.
+static Napi::Value SettleOnRenderThread(Napi::Env env, std::function<PendingPromise::Resolver(MyApp&)> job) {
+  PendingPromise pending(env);
+  RenderThread::instance().Dispatch([pending, job = std::move(job)](MyApp& app) {
+    PendingPromise::Resolver resolve;
+    try {
+      resolve = job(app);
+    } catch (...) {
+      pending.Reject(std::current_exception());
+      return;
+    }
+    pending.Resolve(std::move(resolve));
+  });
+  return pending.Promise();
+}
 
-    renderer_ = Renderer::Create();
+Napi::Value init(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
 
-    ViewConfig view_config;
-    view_config.initial_device_scale = 1.0;
-    view_config.is_accelerated = false;
+  WarmupOptions options;
 
-    view_ = renderer_->CreateView(1600, 800, view_config, nullptr);
-    view_->set_load_listener(this);
-    view_->set_view_listener(this);
+  if (info.Length() >= 1 && info[0].IsObject()) {
+    Napi::Object optionsObj = info[0].As<Napi::Object>();
+
+    Napi::Value warmupHtml = optionsObj.Get("warmupHtml");
+    if (warmupHtml.IsString()) {
+      options.html.push_back(warmupHtml.As<Napi::String>().Utf8Value());
+    } else if (warmupHtml.IsArray()) {
+      Napi::Array htmlArray = warmupHtml.As<Napi::Array>();
+      for (uint32_t i = 0; i < htmlArray.Length(); i++) {
+        Napi::Value html = htmlArray[i];
+        if (html.IsString())
+          options.html.push_back(html.As<Napi::String>().Utf8Value());
+      }
+    }
+
+    Napi::Value fonts = optionsObj.Get("fonts");
+    if (fonts.IsArray()) {
+      Napi::Array fontArray = fonts.As<Napi::Array>();
+      for (uint32_t i = 0; i < fontArray.Length(); i++) {
+        Napi::Value font = fontArray[i];
+        if (font.IsString())
+          options.fonts.push_back(font.As<Napi::String>().Utf8Value());
+      }
+    }
+
+    Napi::Value views = optionsObj.Get("views");
+    if (views.IsNumber())
+      options.views = views.As<Napi::Number>().Uint32Value();
+
+    Napi::Value loadTimeoutMs = optionsObj.Get("loadTimeoutMs");
+    if (loadTimeoutMs.IsNumber())
+      options.load_timeout_ms = loadTimeoutMs.As<Napi::Number>().Uint32Value();
+
+    Napi::Value maxPixels = optionsObj.Get("maxPixels");
+    if (maxPixels.IsNumber())
+      options.max_pixels = (uint64_t)maxPixels.As<Napi::Number>().Int64Value();
+
+    Napi::Value maxFullPageHeight = optionsObj.Get("maxFullPageHeight");
+    if (maxFullPageHeight.IsNumber())
+      options.max_full_page_height = maxFullPageHeight.As<Napi::Number>().Uint32Value();
+
+    Napi::Value surfacePoolBytes = optionsObj.Get("surfacePoolBytes");
+    if (surfacePoolBytes.IsNumber())
+      options.surface_pool_bytes = (uint64_t)surfacePoolBytes.As<Napi::Number>().Int64Value();
   }
 
-  ~MyApp() {
-    view_ = nullptr;
-    renderer_ = nullptr;
+  return SettleOnRenderThread(env, [options](MyApp& app) -> PendingPromise::Resolver {
+    app.Warmup(options);
+    RenderThread::instance().set_ready(true);
+    return [](Napi::Env env) { return Napi::Boolean::New(env, true); };
+  });
+}
+
+Napi::Value isReady(const Napi::CallbackInfo& info) {
+  return Napi::Boolean::New(info.Env(), RenderThread::instance().is_ready());
+}
+
+static void ReadString(Napi::Object obj, const char* name, std::string& out) {
+  Napi::Value value = obj.Get(name);
+  if (value.IsString())
+    out = value.As<Napi::String>().Utf8Value();
+}
+
+static void ReadBool(Napi::Object obj, const char* name, bool& out) {
+  Napi::Value value = obj.Get(name);
+  if (value.IsBoolean())
+    out = value.As<Napi::Boolean>().Value();
+}
+
+// { javascript, images, transparent, fontFamily, fixedFontFamily,
+//   serifFontFamily, sansSerifFontFamily, userAgent }
+static void ParseViewProfile(Napi::Value value, ViewProfile& profile) {
+  if (!value.IsObject())
+    return;
+
+  Napi::Object obj = value.As<Napi::Object>();
+  ReadBool(obj, "javascript", profile.enable_javascript);
+  ReadBool(obj, "images", profile.enable_images);
+  ReadBool(obj, "transparent", profile.is_transparent);
+  ReadString(obj, "fontFamily", profile.font_family_standard);
+  ReadString(obj, "fixedFontFamily", profile.font_family_fixed);
+  ReadString(obj, "serifFontFamily", profile.font_family_serif);
+  ReadString(obj, "sansSerifFontFamily", profile.font_family_sans_serif);
+  ReadString(obj, "userAgent", profile.user_agent);
+}
+
+static bool ParseScale(Napi::Env env, Napi::Object obj, CaptureOptions& capture) {
+  Napi::Value scale = obj.Get("scale");
+  if (scale.IsUndefined())
+    return true;
+
+  double value = scale.IsNumber() ? scale.As<Napi::Number>().DoubleValue() : 0.0;
+  if (!(value >= 0.25 && value <= 4.0)) {
+    Napi::RangeError::New(env, "scale must be a number between 0.25 and 4").ThrowAsJavaScriptException();
+    return false;
   }
+  capture.scale = value;
+  return true;
+}
 
-public:
-  static MyApp& instance() {
-    static MyApp app;
-    return app;
+// tileHeight must be a positive integer. Smaller bands are raised to
+// kMinTileHeight; MyApp caps larger ones at the full-page height limit.
+static bool ParseTileHeight(Napi::Env env, Napi::Object obj, CaptureOptions& capture) {
+  Napi::Value tile_height = obj.Get("tileHeight");
+  if (tile_height.IsUndefined())
+    return true;
+
+  double value = tile_height.IsNumber() ? tile_height.As<Napi::Number>().DoubleValue() : 0.0;
+  if (!(value >= 1) || value != std::floor(value)) {
+    Napi::RangeError::New(env, "tileHeight must be a positive integer").ThrowAsJavaScriptException();
+    return false;
   }
+  capture.tile_height = (uint32_t)std::clamp(value, (double)kMinTileHeight, (double)UINT32_MAX);
+  return true;
+}
 
-  ultralight::RefPtr<ultralight::Buffer> Run(const String& html_string, uint32_t width = 1600, uint32_t height = 800) {
-    LogMessage(LogLevel::Info, "Starting Run(), waiting for page to load...");
-    
-    useLocalImages_ = false;
-    view_->Resize(width, height);
-    
-    view_->LoadHTML(html_string);
-    LogMessage(LogLevel::Info, "Html String loaded into the View.");
+// Reads `name` as a non-empty array of { width, height? } with positive
+// widths, for output sizes and viewports.
+template <typename T>
+static bool ParseDimensions(Napi::Env env, Napi::Object obj, const char* name, std::vector<T>& out) {
+  Napi::Value list = obj.Get(name);
+  if (list.IsUndefined())
+    return true;
 
-    done_ = false;
-    do {
-      renderer_->Update();
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    } while (!done_);
+  if (list.IsArray()) {
+    Napi::Array array = list.As<Napi::Array>();
+    for (uint32_t i = 0; i < array.Length(); i++) {
+      Napi::Value entry = array.Get(i);
+      if (!entry.IsObject())
+        break;
+      Napi::Object size = entry.As<Napi::Object>();
+      Napi::Value width = size.Get("width");
+      Napi::Value height = size.Get("height");
+
+      T dimensions;
+      dimensions.width = width.IsNumber() ? width.As<Napi::Number>().Uint32Value() : 0;
+      dimensions.height = height.IsNumber() ? height.As<Napi::Number>().Uint32Value() : 0;
+      if (!dimensions.width)
+        break;
+      out.push_back(dimensions);
+    }
+    if (out.size() == array.Length() && !out.empty())
+      return true;
+  }
 
-    renderer_->RefreshDisplay(0);
-    renderer_->Render();
+  Napi::RangeError::New(env, std::string(name) + " must be a non-empty array of { width, height? } with positive width")
+      .ThrowAsJavaScriptException();
+  return false;
+}
 
-    BitmapSurface* bitmap_surface = (BitmapSurface*)view_->surface();
-    RefPtr<Bitmap> bitmap = bitmap_surface->bitmap();
-    ultralight::RefPtr<ultralight::Buffer> buffer = bitmap->EncodePNG();
-    
-    LogMessage(LogLevel::Info, "Saved a render of our page to result.png.");
+// { durationMs, fps? } with a duration of 1 ms to 60 s and 1 to 60 fps.
+static bool ParseAnimation(Napi::Env env, Napi::Object obj, CaptureOptions& capture) {
+  Napi::Value animation = obj.Get("animation");
+  if (animation.IsUndefined())
+    return true;
 
-    return buffer;
+  if (animation.IsObject()) {
+    Napi::Object options = animation.As<Napi::Object>();
+    Napi::Value duration = options.Get("durationMs");
+    Napi::Value fps = options.Get("fps");
+    double duration_ms = duration.IsNumber() ? duration.As<Napi::Number>().DoubleValue() : 0.0;
+    double frames = fps.IsUndefined() ? capture.animation_fps : 0.0;
+    if (fps.IsNumber())
+      frames = fps.As<Napi::Number>().DoubleValue();
+    if (duration_ms >= 1 && duration_ms <= 60000 && frames >= 1 && frames <= 60) {
+      capture.animation_duration_ms = (uint32_t)duration_ms;
+      capture.animation_fps = (uint32_t)frames;
+      return true;
+    }
   }
 
-  ultralight::RefPtr<ultralight::Buffer> RunWithImages(const String& html_string, 
-                                                    const std::map<std::string, std::string>& imagePaths, 
-                                                    uint32_t width = 1600, 
-                                                    uint32_t height = 800) {
-    LogMessage(LogLevel::Info, "Starting RunWithImages(), waiting for page to load...");
-    
-    imagePaths_ = imagePaths;
-    useLocalImages_ = true;
-    
-    view_->Resize(width, height);
-    
-    String modified_html = PreprocessHtml(html_string);
-    
-    view_->LoadHTML(modified_html);
-    LogMessage(LogLevel::Info, "Html String with embedded images loaded into the View.");
+  Napi::RangeError::New(env, "animation must be { durationMs, fps? } with durationMs up to 60000 and fps from 1 to 60")
+      .ThrowAsJavaScriptException();
+  return false;
+}
 
-    done_ = false;
-    do {
-      renderer_->Update();
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    } while (!done_);
+// { mode?, hosts?, remoteBudgetMs? } with mode "allow", "block" or
+// "allowlist". Hosts without a mode mean "allowlist".
+static bool ParseNetworkPolicy(Napi::Env env, Napi::Object obj, NetworkPolicy& policy) {
+  Napi::Value network = obj.Get("network");
+  if (network.IsUndefined())
+    return true;
 
-    renderer_->RefreshDisplay(0);
-    renderer_->Render();
+  bool valid = network.IsObject();
+  if (valid) {
+    Napi::Object options = network.As<Napi::Object>();
+    Napi::Value mode = options.Get("mode");
+    Napi::Value hosts = options.Get("hosts");
+    Napi::Value budget = options.Get("remoteBudgetMs");
 
-    BitmapSurface* bitmap_surface = (BitmapSurface*)view_->surface();
-    RefPtr<Bitmap> bitmap = bitmap_surface->bitmap();
-    ultralight::RefPtr<ultralight::Buffer> buffer = bitmap->EncodePNG();
-    
-    LogMessage(LogLevel::Info, "Saved a render of our page with images to result.png.");
-    
-    return buffer;
+    if (hosts.IsArray()) {
+      Napi::Array array = hosts.As<Napi::Array>();
+      for (uint32_t i = 0; i < array.Length() && valid; i++) {
+        Napi::Value host = array.Get(i);
+        valid = host.IsString();
+        if (valid)
+          policy.hosts.push_back(host.As<Napi::String>().Utf8Value());
+      }
+      policy.mode = NetworkPolicy::Mode::AllowList;
+    } else {
+      valid = hosts.IsUndefined();
+    }
+
+    if (mode.IsString())
+      valid = valid && NetworkPolicy::ParseMode(mode.As<Napi::String>().Utf8Value(), &policy.mode);
+    else
+      valid = valid && mode.IsUndefined();
+
+    double budget_ms = budget.IsNumber() ? budget.As<Napi::Number>().DoubleValue() : 0.0;
+    if (budget.IsNumber() && budget_ms >= 0 && budget_ms <= 600000)
+      policy.remote_budget_ms = (uint32_t)budget_ms;
+    else
+      valid = valid && budget.IsUndefined();
   }
+  if (valid)
+    return true;
+
+  Napi::RangeError::New(env, "network must be { mode?: \"allow\" | \"block\" | \"allowlist\", hosts?: string[], "
+                             "remoteBudgetMs? } with remoteBudgetMs up to 600000")
+      .ThrowAsJavaScriptException();
+  return false;
+}
 
-  String PreprocessHtml(const String& html) {
-    std::string htmlStr = html.utf8().data();
+static bool ParseRenderRequest(const Napi::CallbackInfo& info, bool with_images,
+                               RenderRequest& request, bool streaming = false) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1) {
+    Napi::TypeError::New(env, "Wrong number of arguments")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  if (!info[0].IsString()) {
+    Napi::TypeError::New(env, with_images ? "First argument must be a string"
+                                          : "Argument must be a string")
+        .ThrowAsJavaScriptException();
+    return false;
+  }
+
+  if (info.Length() >= 3 && info[1].IsNumber() && info[2].IsNumber()) {
+    request.width = info[1].As<Napi::Number>().Uint32Value();
+    request.height = info[2].As<Napi::Number>().Uint32Value();
+  }
+
+  if (with_images && info.Length() >= 4 && info[3].IsObject()) {
+    Napi::Object pathsObj = info[3].As<Napi::Object>();
+    Napi::Array propertyNames = pathsObj.GetPropertyNames();
     
-    for (const auto& pair : imagePaths_) {
-      const std::string& imageName = pair.first;
-      const std::string& imagePath = pair.second;
+    for (uint32_t i = 0; i < propertyNames.Length(); i++) {
+      Napi::Value key = propertyNames[i];
+      Napi::Value value = pathsObj.Get(key);
       
-      std::string dataUrl = GetImageDataUrl(imagePath);
-      if (!dataUrl.empty()) {
-        std::string localRef = "url('local://" + imageName + "')";
-        std::string dataUrlRef = "url('" + dataUrl + "')";
-        
-        size_t pos = 0;
-        while ((pos = htmlStr.find(localRef, pos)) != std::string::npos) {
-          htmlStr.replace(pos, localRef.length(), dataUrlRef);
-          pos += dataUrlRef.length();
-        }
-        
-        localRef = "url(\"local://" + imageName + "\")";
-        while ((pos = htmlStr.find(localRef, pos)) != std::string::npos) {
-          htmlStr.replace(pos, localRef.length(), dataUrlRef);
-          pos += dataUrlRef.length();
-        }
-        
-        localRef = "url(local://" + imageName + ")";
-        while ((pos = htmlStr.find(localRef, pos)) != std::string::npos) {
-          htmlStr.replace(pos, localRef.length(), dataUrlRef);
-          pos += dataUrlRef.length();
-        }
+      if (key.IsString() && value.IsString()) {
+        std::string keyStr = key.As<Napi::String>().Utf8Value();
+        std::string valueStr = value.As<Napi::String>().Utf8Value();
+        request.imagePaths[keyStr] = valueStr;
       }
     }
-    
-    return String(htmlStr.c_str());
-  }
-  
-  std::string GetImageDataUrl(const std::string& imagePath) {
-    std::ifstream file(imagePath, std::ios::binary);
-    if (!file) {
-      LogMessage(LogLevel::Error, "Failed to open image file: " + String(imagePath.c_str()));
-      return "";
-    }
-    
-    file.seekg(0, std::ios::end);
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-    
-    std::vector<uint8_t> buffer(size);
-    if (!file.read(reinterpret_cast<char*>(buffer.data()), size)) {
-      LogMessage(LogLevel::Error, "Failed to read image file: " + String(imagePath.c_str()));
-      return "";
-    }
-    
-    std::string mimeType = "image/png"; 
-    std::string ext = imagePath.substr(imagePath.find_last_of(".") + 1);
-    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return std::tolower(c); });
-    
-    if (ext == "jpg" || ext == "jpeg") {
-      mimeType = "image/jpeg";
-    } else if (ext == "gif") {
-      mimeType = "image/gif";
-    } else if (ext == "webp") {
-      mimeType = "image/webp";
-    } else if (ext == "svg") {
-      mimeType = "image/svg+xml";
-    }
-    
-    std::string base64Data = Base64Encode(buffer.data(), buffer.size());
-    std::string dataUrl = "data:" + mimeType + ";base64," + base64Data;
-    
-    return dataUrl;
   }
-  
-  std::string Base64Encode(const uint8_t* data, size_t length) {
-    static const char* encoding = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    std::string out;
-    out.reserve(((length + 2) / 3) * 4);
-    
-    uint32_t value;
-    for (size_t i = 0; i < length; i += 3) {
-      value = data[i] << 16;
-      if (i + 1 < length) value |= data[i + 1] << 8;
-      if (i + 2 < length) value |= data[i + 2];
-      
-      out.push_back(encoding[(value >> 18) & 0x3F]);
-      out.push_back(encoding[(value >> 12) & 0x3F]);
-      out.push_back((i + 1 < length) ? encoding[(value >> 6) & 0x3F] : '=');
-      out.push_back((i + 2 < length) ? encoding[value & 0x3F] : '=');
-    }
-    
-    return out;
+
+  size_t options_index = with_images ? 4 : 3;
+  if (info.Length() > options_index && info[options_index].IsObject()) {
+    Napi::Object optionsObj = info[options_index].As<Napi::Object>();
+
+    Napi::Value timings = optionsObj.Get("timings");
+    if (timings.IsBoolean())
+      request.return_timings = timings.As<Napi::Boolean>().Value();
+
+    Napi::Value cache = optionsObj.Get("cache");
+    if (cache.IsBoolean())
+      request.use_cache = cache.As<Napi::Boolean>().Value();
+
+    ParseViewProfile(optionsObj.Get("view"), request.profile);
+    ReadBool(optionsObj, "staticFastPath", request.static_fast_path);
+
+    if (!ParseScale(env, optionsObj, request.capture))
+      return false;
+    ReadBool(optionsObj, "fullPage", request.capture.full_page);
+
+    if (!ParseTileHeight(env, optionsObj, request.capture) ||
+        !ParseDimensions(env, optionsObj, "sizes", request.capture.sizes) ||
+        !ParseDimensions(env, optionsObj, "viewports", request.capture.viewports) ||
+        !ParseAnimation(env, optionsObj, request.capture) ||
+        !ParseNetworkPolicy(env, optionsObj, request.network))
+      return false;
+    ReadString(optionsObj, "selector", request.capture.selector);
+    ReadBool(optionsObj, "trim", request.capture.trim);
   }
 
-  virtual void OnFinishLoading(ultralight::View* caller, uint64_t frame_id, bool is_main_frame,
-                               const String& url) override {
-    if (is_main_frame) {
-      LogMessage(LogLevel::Info, "Our page has loaded!");
-      done_ = true;
-    }
+  if (const char* error = CaptureOptionsError(request.capture, streaming)) {
+    Napi::TypeError::New(env, error).ThrowAsJavaScriptException();
+    return false;
   }
 
-  virtual void OnDOMReady(ultralight::View* caller,
-                         uint64_t frame_id,
-                         bool is_main_frame,
-                         const String& url) override {
-    if (is_main_frame && useLocalImages_) {
-      LogMessage(LogLevel::Info, "DOM is ready, processing any dynamic content...");
-      
-      std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
+  request.html = info[0].As<Napi::String>().Utf8Value();
+  request.with_images = with_images;
+  return true;
+}
+
+static const char* CacheStatusName(CacheStatus status) {
+  switch (status) {
+    case CacheStatus::MemoryHit: return "memory";
+    case CacheStatus::DiskHit: return "disk";
+    case CacheStatus::Coalesced: return "coalesced";
+    default: return "miss";
+  }
+}
+
+static Napi::Object TimingsToObject(Napi::Env env, const RenderResponse& response) {
+  const RenderTimings& t = response.timings;
+
+  Napi::Object timestamps = Napi::Object::New(env);
+  timestamps.Set("enqueued", 0.0);
+  timestamps.Set("started", t.SinceEnqueued(t.started));
+  timestamps.Set("loadBegin", t.SinceEnqueued(t.load_begin));
+  timestamps.Set("domReady", t.SinceEnqueued(t.dom_ready));
+  timestamps.Set("loadEnd", t.SinceEnqueued(t.load_end));
+  timestamps.Set("resizeBegin", t.SinceEnqueued(t.resize_begin));
+  timestamps.Set("resizeEnd", t.SinceEnqueued(t.resize_end));
+  timestamps.Set("paintBegin", t.SinceEnqueued(t.paint_begin));
+  timestamps.Set("paintEnd", t.SinceEnqueued(t.paint_end));
+  timestamps.Set("encodeBegin", t.SinceEnqueued(t.encode_begin));
+  timestamps.Set("encodeEnd", t.SinceEnqueued(t.encode_end));
+  timestamps.Set("copyBegin", t.SinceEnqueued(t.copy_begin));
+  timestamps.Set("copyEnd", t.SinceEnqueued(t.copy_end));
+
+  Napi::Object timings = Napi::Object::New(env);
+  timings.Set("queueMs", RenderTimings::Between(t.enqueued, t.started));
+  timings.Set("parseMs", RenderTimings::Between(t.load_begin, t.dom_ready));
+  timings.Set("resourcesMs", RenderTimings::Between(t.dom_ready, t.load_end));
+  timings.Set("resizeMs", RenderTimings::Between(t.resize_begin, t.resize_end));
+  timings.Set("paintMs", RenderTimings::Between(t.paint_begin, t.paint_end));
+  timings.Set("encodeMs", RenderTimings::Between(t.encode_begin, t.encode_end));
+  timings.Set("copyMs", RenderTimings::Between(t.copy_begin, t.copy_end));
+  timings.Set("totalMs", RenderTimings::Between(t.enqueued, t.copy_end));
+  timings.Set("updateIterations", (double)t.update_iterations);
+  timings.Set("pixels", (double)t.pixels);
+  timings.Set("bytesIn", (double)t.bytes_in);
+  timings.Set("bytesOut", (double)t.bytes_out);
+  if (EngineHeap::installed()) {
+    Napi::Object heap_peak = Napi::Object::New(env);
+    heap_peak.Set("load", (double)t.heap_peak_load);
+    heap_peak.Set("paint", (double)t.heap_peak_paint);
+    heap_peak.Set("encode", (double)t.heap_peak_encode);
+    timings.Set("heapAllocatedBytes", (double)t.heap_allocated_bytes);
+    timings.Set("heapPeakBytes", heap_peak);
   }
+  timings.Set("cache", CacheStatusName(response.cache));
+  timings.Set("staticFastPath", response.static_fast_path);
+  timings.Set("timestamps", timestamps);
+  return timings;
+}
+
+// Copies the PNG into a Node Buffer and, when requested, wraps it together
+// with the timing breakdown as { png, timings, crop? }. Requests with output
+// sizes or viewports get an array of Buffers instead, or { pngs, timings }.
+static Napi::Value ResponseToValue(Napi::Env env, bool return_timings, RenderResponse& response) {
+  response.timings.copy_begin = RenderTimings::Clock::now();
+  Napi::Value value;
+  if (response.pngs.empty()) {
+    value = Napi::Buffer<char>::Copy(env, (const char*)response.png->data(), response.png->size());
+  } else {
+    Napi::Array pngs = Napi::Array::New(env, response.pngs.size());
+    for (uint32_t i = 0; i < response.pngs.size(); i++)
+      pngs.Set(i, Napi::Buffer<char>::Copy(env, (const char*)response.pngs[i]->data(), response.pngs[i]->size()));
+    value = pngs;
+  }
+  response.timings.copy_end = RenderTimings::Clock::now();
+  Tracer::instance().AddComplete("Copy", response.timings.copy_begin, response.timings.copy_end);
+
+  if (!return_timings)
+    return value;
 
-  virtual void LogMessage(LogLevel log_level, const String& message) override {
-    std::cout << "> " << message.utf8().data() << std::endl << std::endl;
+  Napi::Object result = Napi::Object::New(env);
+  result.Set(response.pngs.empty() ? "png" : "pngs", value);
+  result.Set("timings", TimingsToObject(env, response));
+  if (response.trimmed) {
+    Napi::Object crop = Napi::Object::New(env);
+    crop.Set("x", (double)response.crop.x);
+    crop.Set("y", (double)response.crop.y);
+    crop.Set("width", (double)response.crop.width);
+    crop.Set("height", (double)response.crop.height);
+    result.Set("crop", crop);
   }
+  return result;
+}
+
+static const char* RenderFailureMessage(const RenderRequest& request) {
+  return request.with_images ? "Failed to render HTML with images" : "Failed to render HTML";
+}
+
+// Starts an async render. Only the cache lookup, which hashes the request
+// and may read image files and the disk cache, runs on the threadpool; the
+// worker returns as soon as the render is queued, and the RenderThread, or
+// the lookup itself on a hit, settles the promise.
+class RenderWorker : public Napi::AsyncWorker {
+public:
+  RenderWorker(Napi::Env env, RenderRequest request)
+      : Napi::AsyncWorker(env), pending_(env), request_(std::move(request)) {}
+
+  Napi::Promise Promise() { return pending_.Promise(); }
+
+protected:
+  void Execute() override {
+    PendingPromise pending = pending_;
+    bool return_timings = request_.return_timings;
+    const char* failure = RenderFailureMessage(request_);
+    try {
+      ProcessRenderRequestAsync(std::move(request_), [pending, return_timings, failure](RenderResponse response,
+                                                                                        std::exception_ptr error) {
+        if (error)
+          return pending.Reject(error);
+        if (!response.png && response.pngs.empty())
+          return pending.Reject(failure);
+        auto result = std::make_shared<RenderResponse>(std::move(response));
+        pending.Resolve([result, return_timings](Napi::Env env) {
+          return ResponseToValue(env, return_timings, *result);
+        });
+      });
+    } catch (...) {
+      pending.Reject(std::current_exception());
+    }
+  }
+
+  // Settled through pending_ instead.
+  void OnOK() override {}
+  void OnError(const Napi::Error& error) override {}
+
+private:
+  PendingPromise pending_;
+  RenderRequest request_;
 };
 
-Napi::Value renderHtmlToPNG(const Napi::CallbackInfo& info) {
+static Napi::Value RenderSync(const Napi::CallbackInfo& info, bool with_images) {
   Napi::Env env = info.Env();
 
-  if (info.Length() < 1) {
-    Napi::TypeError::New(env, "Wrong number of arguments")
-        .ThrowAsJavaScriptException();
+  RenderRequest request;
+  if (!ParseRenderRequest(info, with_images, request))
+    return env.Null();
+
+  RenderResponse response;
+  try {
+    response = ProcessRenderRequest(request);
+  } catch (const std::exception& e) {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
     return env.Null();
   }
 
-  if (!info[0].IsString()) {
-    Napi::TypeError::New(env, "Argument must be a string").ThrowAsJavaScriptException();
+  if (!response.png && response.pngs.empty()) {
+    Napi::Error::New(env, RenderFailureMessage(request)).ThrowAsJavaScriptException();
     return env.Null();
   }
 
-  uint32_t width = 1600;
-  uint32_t height = 800;
-  
-  if (info.Length() >= 3 && info[1].IsNumber() && info[2].IsNumber()) {
-    width = info[1].As<Napi::Number>().Uint32Value();
-    height = info[2].As<Napi::Number>().Uint32Value();
+  return ResponseToValue(env, request.return_timings, response);
+}
+
+static Napi::Value RenderAsync(const Napi::CallbackInfo& info, bool with_images) {
+  Napi::Env env = info.Env();
+
+  RenderRequest request;
+  if (!ParseRenderRequest(info, with_images, request))
+    return env.Null();
+
+  RenderWorker* worker = new RenderWorker(env, std::move(request));
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+// Streams the PNG to a JavaScript callback as the encoder produces it. Chunks
+// and the final result travel through the same thread-safe function, and
+// the promise settles in its finalizer, so it never settles before the last
+// chunk has been delivered.
+//
+// The callback is called as onChunk(chunk, resume). At most
+// kStreamQueueChunks chunks wait for the JavaScript thread; past that the
+// encoder blocks. When onChunk returns false the encoder also waits, until
+// resume() is called or kStreamStallMs pass. The encoder runs on the render
+// thread, so the first stall that runs out the limit abandons backpressure
+// for the rest of the stream: the remaining chunks buffer in Node rather than
+// holding up every other render once per chunk.
+static constexpr size_t kStreamQueueChunks = 4;
+static constexpr auto kStreamStallMs = std::chrono::milliseconds(2000);
+
+class StreamSession {
+public:
+  // Queues the render on the RenderThread and returns its promise.
+  static Napi::Promise Start(Napi::Env env, RenderRequest request, Napi::Function on_chunk) {
+    Context* context = new Context(env);
+    std::shared_ptr<FlowGate> gate = context->gate;
+    context->resume = Napi::Persistent(Napi::Function::New(env, [gate](const Napi::CallbackInfo& info) {
+      gate->Resume();
+    }, "resume"));
+    Napi::ThreadSafeFunction chunks = Napi::ThreadSafeFunction::New(
+        env, on_chunk, "renderStream", kStreamQueueChunks, 1, context, [](Napi::Env env, Context* context) {
+          Settle(env, context);
+          delete context;
+        });
+    Napi::Promise promise = context->deferred.Promise();
+
+    auto sink = [chunks, context](const uint8_t* data, size_t size) {
+      auto* chunk = new std::vector<uint8_t>(data, data + size);
+      if (chunks.BlockingCall(chunk, [context](Napi::Env env, Napi::Function on_chunk,
+                                               std::vector<uint8_t>* chunk) {
+            DeliverChunk(env, on_chunk, context, chunk);
+          }) != napi_ok) {
+        delete chunk;
+        return;
+      }
+      context->gate->WaitWhilePaused(kStreamStallMs);
+    };
+    auto done = [chunks, context](RenderResponse response, std::exception_ptr error) {
+      if (error) {
+        context->error = ErrorMessage(error);
+        context->failed = true;
+      } else {
+        context->response = std::move(response);
+      }
+      chunks.Release();
+    };
+    try {
+      StreamRenderRequestAsync(std::move(request), sink, done);
+    } catch (...) {
+      done(RenderResponse(), std::current_exception());
+    }
+    return promise;
   }
 
-  std::string html_string = info[0].As<Napi::String>().Utf8Value();
-  ultralight::String html_string_ul = ultralight::String(html_string.c_str());
+private:
+  // Set from the JavaScript thread when onChunk returns false, cleared by
+  // resume(). Once a wait runs out its limit the gate is abandoned and never
+  // closes again. Shared with the resume function, which may outlive the
+  // stream.
+  struct FlowGate {
+    std::mutex mutex;
+    std::condition_variable resumed;
+    bool paused = false;
+    bool abandoned = false;
 
-  ultralight::RefPtr<ultralight::Buffer> buffer = MyApp::instance().Run(html_string_ul, width, height);
+    void Pause() {
+      std::lock_guard<std::mutex> lock(mutex);
+      paused = !abandoned;
+    }
 
-  if (!buffer) {
-    Napi::Error::New(env, "Failed to render HTML").ThrowAsJavaScriptException();
+    void Resume() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        paused = false;
+      }
+      resumed.notify_all();
+    }
+
+    void WaitWhilePaused(std::chrono::milliseconds limit) {
+      std::unique_lock<std::mutex> lock(mutex);
+      if (!resumed.wait_for(lock, limit, [this] { return !paused; }))
+        abandoned = true;
+      paused = false;
+    }
+  };
+
+  struct Context {
+    explicit Context(Napi::Env env) : deferred(Napi::Promise::Deferred::New(env)) {}
+
+    Napi::Promise::Deferred deferred;
+    Napi::FunctionReference resume;
+    std::shared_ptr<FlowGate> gate = std::make_shared<FlowGate>();
+    RenderResponse response;
+    std::string error;
+    bool failed = false;
+  };
+
+  static void DeliverChunk(Napi::Env env, Napi::Function on_chunk, Context* context,
+                           std::vector<uint8_t>* chunk) {
+    if (env == nullptr || on_chunk == nullptr) {
+      delete chunk;
+      return;
+    }
+    Napi::Value more = on_chunk.Call({ Napi::Buffer<uint8_t>::New(
+        env, chunk->data(), chunk->size(),
+        [](Napi::Env, uint8_t*, std::vector<uint8_t>* bytes) { delete bytes; }, chunk),
+        context->resume.Value() });
+    if (more.IsBoolean() && !more.As<Napi::Boolean>().Value())
+      context->gate->Pause();
+  }
+
+  static void Settle(Napi::Env env, Context* context) {
+    if (context->failed) {
+      context->deferred.Reject(Napi::Error::New(env, context->error).Value());
+      return;
+    }
+
+    RenderTimings& t = context->response.timings;
+    t.copy_begin = t.encode_end;
+    t.copy_end = RenderTimings::Clock::now();
+    context->deferred.Resolve(TimingsToObject(env, context->response));
+  }
+};
+
+static Napi::Value RenderStream(const Napi::CallbackInfo& info, bool with_images) {
+  Napi::Env env = info.Env();
+
+  size_t callback_index = with_images ? 5 : 4;
+  if (info.Length() <= callback_index || !info[callback_index].IsFunction()) {
+    Napi::TypeError::New(env, "Last argument must be a chunk callback").ThrowAsJavaScriptException();
     return env.Null();
   }
 
-  Napi::Buffer<char> napiBuffer = Napi::Buffer<char>::Copy(env, (char*)buffer->data(), buffer->size());
+  RenderRequest request;
+  if (!ParseRenderRequest(info, with_images, request, true))
+    return env.Null();
 
-  return napiBuffer;
+  return StreamSession::Start(env, std::move(request), info[callback_index].As<Napi::Function>());
+}
+
+Napi::Value renderHtmlToPNG(const Napi::CallbackInfo& info) {
+  return RenderSync(info, false);
 }
 
 Napi::Value renderHtmlToPNGWithImages(const Napi::CallbackInfo& info) {
+  return RenderSync(info, true);
+}
+
+Napi::Value renderHtmlToPNGAsync(const Napi::CallbackInfo& info) {
+  return RenderAsync(info, false);
+}
+
+Napi::Value renderHtmlToPNGWithImagesAsync(const Napi::CallbackInfo& info) {
+  return RenderAsync(info, true);
+}
+
+Napi::Value renderHtmlToPNGStream(const Napi::CallbackInfo& info) {
+  return RenderStream(info, false);
+}
+
+Napi::Value renderHtmlToPNGWithImagesStream(const Napi::CallbackInfo& info) {
+  return RenderStream(info, true);
+}
+
+Napi::Value configureCache(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
 
-  if (info.Length() < 1) {
-    Napi::TypeError::New(env, "Wrong number of arguments")
-        .ThrowAsJavaScriptException();
+  if (info.Length() < 1 || !info[0].IsObject()) {
+    Napi::TypeError::New(env, "Argument must be an object").ThrowAsJavaScriptException();
     return env.Null();
   }
 
-  if (!info[0].IsString()) {
-    Napi::TypeError::New(env, "First argument must be a string").ThrowAsJavaScriptException();
+  Napi::Object optionsObj = info[0].As<Napi::Object>();
+  CacheOptions options;
+
+  Napi::Value maxBytes = optionsObj.Get("maxBytes");
+  if (maxBytes.IsNumber())
+    options.memory_bytes = (size_t)maxBytes.As<Napi::Number>().Int64Value();
+
+  Napi::Value diskPath = optionsObj.Get("diskPath");
+  if (diskPath.IsString())
+    options.disk_path = diskPath.As<Napi::String>().Utf8Value();
+
+  Napi::Value diskMaxBytes = optionsObj.Get("diskMaxBytes");
+  if (diskMaxBytes.IsNumber())
+    options.disk_bytes = (size_t)diskMaxBytes.As<Napi::Number>().Int64Value();
+
+  Napi::Value ttlMs = optionsObj.Get("ttlMs");
+  if (ttlMs.IsNumber())
+    options.ttl_ms = ttlMs.As<Napi::Number>().Uint32Value();
+
+  RenderCache::instance().Configure(options);
+  return env.Undefined();
+}
+
+Napi::Value clearCache(const Napi::CallbackInfo& info) {
+  RenderCache::instance().Clear();
+  return info.Env().Undefined();
+}
+
+Napi::Value setLogLevel(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  int level;
+  if (info.Length() < 1 || !info[0].IsString() ||
+      !AsyncLogger::ParseLevel(info[0].As<Napi::String>().Utf8Value(), &level)) {
+    Napi::TypeError::New(env, "Expected one of: off, error, warning, info").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  AsyncLogger::instance().set_level(level);
+  return env.Undefined();
+}
+
+Napi::Value startTrace(const Napi::CallbackInfo& info) {
+  Tracer::instance().Start();
+  return info.Env().Undefined();
+}
+
+Napi::Value stopTrace(const Napi::CallbackInfo& info) {
+  return Napi::String::New(info.Env(), Tracer::instance().Stop());
+}
+
+Napi::Value getMetrics(const Napi::CallbackInfo& info) {
+  return Napi::String::New(info.Env(), Metrics::instance().Expose());
+}
+
+Napi::Value registerTemplate(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 2 || !info[0].IsString() || !info[1].IsString()) {
+    Napi::TypeError::New(env, "Template id and html must be strings").ThrowAsJavaScriptException();
     return env.Null();
   }
 
   uint32_t width = 1600;
   uint32_t height = 800;
-  
-  if (info.Length() >= 3 && info[1].IsNumber() && info[2].IsNumber()) {
-    width = info[1].As<Napi::Number>().Uint32Value();
-    height = info[2].As<Napi::Number>().Uint32Value();
+
+  if (info.Length() >= 4 && info[2].IsNumber() && info[3].IsNumber()) {
+    width = info[2].As<Napi::Number>().Uint32Value();
+    height = info[3].As<Napi::Number>().Uint32Value();
   }
 
-  std::map<std::string, std::string> imagePaths;
-  if (info.Length() >= 4 && info[3].IsObject()) {
-    Napi::Object pathsObj = info[3].As<Napi::Object>();
-    Napi::Array propertyNames = pathsObj.GetPropertyNames();
-    
-    for (uint32_t i = 0; i < propertyNames.Length(); i++) {
-      Napi::Value key = propertyNames[i];
-      Napi::Value value = pathsObj.Get(key);
-      
-      if (key.IsString() && value.IsString()) {
-        std::string keyStr = key.As<Napi::String>().Utf8Value();
-        std::string valueStr = value.As<Napi::String>().Utf8Value();
-        imagePaths[keyStr] = valueStr;
-      }
+  ViewProfile profile;
+  if (info.Length() >= 5 && info[4].IsObject())
+    ParseViewProfile(info[4].As<Napi::Object>().Get("view"), profile);
+
+  std::string id = info[0].As<Napi::String>().Utf8Value();
+  std::string html_string = info[1].As<Napi::String>().Utf8Value();
+
+  return SettleOnRenderThread(env, [=](MyApp& app) -> PendingPromise::Resolver {
+    app.RegisterTemplate(id, ultralight::String(html_string.c_str()), width, height, profile);
+    return [](Napi::Env env) { return Napi::Boolean::New(env, true); };
+  });
+}
+
+Napi::Value unregisterTemplate(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "Template id must be a string").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  std::string id = info[0].As<Napi::String>().Utf8Value();
+
+  return SettleOnRenderThread(env, [=](MyApp& app) -> PendingPromise::Resolver {
+    bool removed = app.UnregisterTemplate(id);
+    return [removed](Napi::Env env) { return Napi::Boolean::New(env, removed); };
+  });
+}
+
+// Splits the template data object into JSON for its plain properties and the
+// bytes of its ArrayBuffer and typed array properties.
+static void ParseTemplateData(const Napi::CallbackInfo& info, std::string& json,
+                              std::vector<TemplateBinary>& binaries) {
+  Napi::Env env = info.Env();
+  json = "{}";
+  if (info.Length() < 2 || !info[1].IsObject())
+    return;
+
+  Napi::Object dataObj = info[1].As<Napi::Object>();
+  Napi::Object plainObj = Napi::Object::New(env);
+  Napi::Array propertyNames = dataObj.GetPropertyNames();
+
+  for (uint32_t i = 0; i < propertyNames.Length(); i++) {
+    Napi::Value key = propertyNames[i];
+    Napi::Value value = dataObj.Get(key);
+
+    if (value.IsTypedArray()) {
+      Napi::TypedArray typedArray = value.As<Napi::TypedArray>();
+      const uint8_t* bytes = static_cast<const uint8_t*>(typedArray.ArrayBuffer().Data()) +
+                             typedArray.ByteOffset();
+      binaries.push_back({ key.ToString().Utf8Value(),
+                           std::vector<uint8_t>(bytes, bytes + typedArray.ByteLength()) });
+    } else if (value.IsArrayBuffer()) {
+      Napi::ArrayBuffer arrayBuffer = value.As<Napi::ArrayBuffer>();
+      const uint8_t* bytes = static_cast<const uint8_t*>(arrayBuffer.Data());
+      binaries.push_back({ key.ToString().Utf8Value(),
+                           std::vector<uint8_t>(bytes, bytes + arrayBuffer.ByteLength()) });
+    } else {
+      plainObj.Set(key, value);
     }
   }
 
-  std::string html_string = info[0].As<Napi::String>().Utf8Value();
-  ultralight::String html_string_ul = ultralight::String(html_string.c_str());
+  Napi::Function stringify = env.Global().Get("JSON").As<Napi::Object>()
+                                 .Get("stringify").As<Napi::Function>();
+  Napi::Value jsonValue = stringify.Call({ plainObj });
+  if (jsonValue.IsString())
+    json = jsonValue.As<Napi::String>().Utf8Value();
+}
+
+Napi::Value renderTemplate(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "Template id must be a string").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  uint32_t width = 0;
+  uint32_t height = 0;
+
+  if (info.Length() >= 4 && info[2].IsNumber() && info[3].IsNumber()) {
+    width = info[2].As<Napi::Number>().Uint32Value();
+    height = info[3].As<Napi::Number>().Uint32Value();
+  }
 
-  ultralight::RefPtr<ultralight::Buffer> buffer = MyApp::instance().RunWithImages(html_string_ul, imagePaths, width, height);
+  TemplateRequest request;
+  request.id = info[0].As<Napi::String>().Utf8Value();
+  request.width = width;
+  request.height = height;
+  ParseTemplateData(info, request.json, request.binaries);
+
+  if (info.Length() >= 5 && info[4].IsObject() &&
+      !ParseScale(env, info[4].As<Napi::Object>(), request.capture))
+    return env.Null();
+
+  PendingPromise pending(env);
+  ProcessTemplateRequestAsync(std::move(request), [pending](TemplateResponse response, std::exception_ptr error) {
+    if (error)
+      return pending.Reject(error);
+    PngData png = response.png;
+    if (!png)
+      return pending.Reject("Failed to render template");
+    pending.Resolve([png](Napi::Env env) -> Napi::Value {
+      return Napi::Buffer<char>::Copy(env, (const char*)png->data(), png->size());
+    });
+  });
+  return pending.Promise();
+}
+
+// renderTemplateDelta(id, data, width, height, { scale, keyframeInterval, keyframe, since })
+// resolves to { keyframe, sequence, width, height, patches: [{ x, y, width, height, png }] }.
+Napi::Value renderTemplateDelta(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
 
-  if (!buffer) {
-    Napi::Error::New(env, "Failed to render HTML with images").ThrowAsJavaScriptException();
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "Template id must be a string").ThrowAsJavaScriptException();
     return env.Null();
   }
 
-  Napi::Buffer<char> napiBuffer = Napi::Buffer<char>::Copy(env, (char*)buffer->data(), buffer->size());
+  uint32_t width = 0;
+  uint32_t height = 0;
 
-  return napiBuffer;
+  if (info.Length() >= 4 && info[2].IsNumber() && info[3].IsNumber()) {
+    width = info[2].As<Napi::Number>().Uint32Value();
+    height = info[3].As<Napi::Number>().Uint32Value();
+  }
+
+  TemplateRequest request;
+  request.id = info[0].As<Napi::String>().Utf8Value();
+  request.width = width;
+  request.height = height;
+  ParseTemplateData(info, request.json, request.binaries);
+
+  DeltaOptions& delta = request.delta;
+  if (info.Length() >= 5 && info[4].IsObject()) {
+    Napi::Object options = info[4].As<Napi::Object>();
+    if (!ParseScale(env, options, request.capture))
+      return env.Null();
+    Napi::Value interval = options.Get("keyframeInterval");
+    if (interval.IsNumber())
+      delta.keyframe_interval = interval.As<Napi::Number>().Uint32Value();
+    ReadBool(options, "keyframe", delta.keyframe);
+    Napi::Value since = options.Get("since");
+    if (since.IsNumber())
+      delta.since = (uint64_t)since.As<Napi::Number>().Int64Value();
+  }
+
+  PendingPromise pending(env);
+  ProcessTemplateDeltaRequestAsync(std::move(request), [pending](TemplateResponse response,
+                                                                 std::exception_ptr error) {
+    if (error)
+      return pending.Reject(error);
+    auto delta = std::make_shared<TemplateDelta>(std::move(response.delta));
+    pending.Resolve([delta](Napi::Env env) -> Napi::Value {
+      const TemplateDelta& result = *delta;
+      Napi::Array patches = Napi::Array::New(env, result.patches.size());
+      for (uint32_t i = 0; i < result.patches.size(); i++) {
+        const PixelRect& rect = result.rects[i];
+        Napi::Object patch = Napi::Object::New(env);
+        patch.Set("x", rect.x);
+        patch.Set("y", rect.y);
+        patch.Set("width", rect.width);
+        patch.Set("height", rect.height);
+        patch.Set("png", Napi::Buffer<char>::Copy(env, (const char*)result.patches[i]->data(),
+                                                 result.patches[i]->size()));
+        patches.Set(i, patch);
+      }
+
+      Napi::Object out = Napi::Object::New(env);
+      out.Set("keyframe", result.keyframe);
+      out.Set("sequence", (double)result.sequence);
+      out.Set("width", result.width);
+      out.Set("height", result.height);
+      out.Set("patches", patches);
+      return out;
+    });
+  });
+  return pending.Promise();
 }
 
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
+  Tracer::instance().SetThreadName("node-main");
+  PlatformOptions platform_options;
+  platform_options.memory = MemoryBudget::FromEnvironment();
+  platform_options.network = NetworkPolicy::FromEnvironment();
+  if (const char* http_cache = getenv("RENDER_HTTP_CACHE_DIR"))
+    platform_options.http_cache_path = http_cache;
+  MyApp::set_platform_options(platform_options);
+  RenderThread::instance();
+
+  exports.Set(Napi::String::New(env, "init"), Napi::Function::New(env, init));
+  exports.Set(Napi::String::New(env, "isReady"), Napi::Function::New(env, isReady));
   exports.Set(Napi::String::New(env, "renderHtmlToPNG"), Napi::Function::New(env, renderHtmlToPNG));
   exports.Set(Napi::String::New(env, "renderHtmlToPNGWithImages"), Napi::Function::New(env, renderHtmlToPNGWithImages));
+  exports.Set(Napi::String::New(env, "renderHtmlToPNGAsync"), Napi::Function::New(env, renderHtmlToPNGAsync));
+  exports.Set(Napi::String::New(env, "renderHtmlToPNGWithImagesAsync"), Napi::Function::New(env, renderHtmlToPNGWithImagesAsync));
+  exports.Set(Napi::String::New(env, "renderHtmlToPNGStream"), Napi::Function::New(env, renderHtmlToPNGStream));
+  exports.Set(Napi::String::New(env, "renderHtmlToPNGWithImagesStream"), Napi::Function::New(env, renderHtmlToPNGWithImagesStream));
+  exports.Set(Napi::String::New(env, "configureCache"), Napi::Function::New(env, configureCache));
+  exports.Set(Napi::String::New(env, "clearCache"), Napi::Function::New(env, clearCache));
+  exports.Set(Napi::String::New(env, "getMetrics"), Napi::Function::New(env, getMetrics));
+  exports.Set(Napi::String::New(env, "setLogLevel"), Napi::Function::New(env, setLogLevel));
+  exports.Set(Napi::String::New(env, "startTrace"), Napi::Function::New(env, startTrace));
+  exports.Set(Napi::String::New(env, "stopTrace"), Napi::Function::New(env, stopTrace));
+  exports.Set(Napi::String::New(env, "registerTemplate"), Napi::Function::New(env, registerTemplate));
+  exports.Set(Napi::String::New(env, "unregisterTemplate"), Napi::Function::New(env, unregisterTemplate));
+  exports.Set(Napi::String::New(env, "renderTemplate"), Napi::Function::New(env, renderTemplate));
+  exports.Set(Napi::String::New(env, "renderTemplateDelta"), Napi::Function::New(env, renderTemplateDelta));
   return exports;
 }
 
@@ -0,0 +1,75 @@
+#include "memory_governor.h"
+#include "metrics.h"
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+const std::chrono::seconds MemoryGovernor::kMinPurgeInterval(5);
+
+// cgroup v2, then v1. Unlimited groups report "max" or a huge number.
+static uint64_t ReadCgroupLimit() {
+  for (const char* path : { "/sys/fs/cgroup/memory.max", "/sys/fs/cgroup/memory/memory.limit_in_bytes" }) {
+    FILE* file = fopen(path, "r");
+    if (!file)
+      continue;
+    unsigned long long limit = 0;
+    int read = fscanf(file, "%llu", &limit);
+    fclose(file);
+    if (read == 1 && limit < (1ull << 50))
+      return limit;
+  }
+  return 0;
+}
+
+static uint64_t ReadEnv(const char* name, uint64_t fallback) {
+  const char* value = getenv(name);
+  return value && *value ? strtoull(value, nullptr, 10) : fallback;
+}
+
+MemoryBudget MemoryBudget::FromEnvironment() {
+  MemoryBudget budget;
+  budget.rss_high_bytes = ReadEnv("RENDER_RSS_HIGH_BYTES", ReadCgroupLimit() / 10 * 8);
+  budget.rss_low_bytes = ReadEnv("RENDER_RSS_LOW_BYTES", budget.rss_high_bytes / 10 * 7);
+  budget.memory_cache_bytes = (uint32_t)ReadEnv("RENDER_MEMORY_CACHE_BYTES", budget.memory_cache_bytes);
+  budget.page_cache_size = (uint32_t)ReadEnv("RENDER_PAGE_CACHE_SIZE", budget.page_cache_size);
+  const char* delay = getenv("RENDER_RECYCLE_DELAY_S");
+  if (delay && *delay)
+    budget.recycle_delay_seconds = strtod(delay, nullptr);
+  budget.view_max_renders = (uint32_t)ReadEnv("RENDER_VIEW_MAX_RENDERS", budget.view_max_renders);
+  return budget;
+}
+
+uint64_t MemoryGovernor::ReadRss() {
+  FILE* file = fopen("/proc/self/statm", "r");
+  if (!file)
+    return 0;
+  unsigned long long size = 0, resident = 0;
+  int read = fscanf(file, "%llu %llu", &size, &resident);
+  fclose(file);
+  return read == 2 ? resident * (uint64_t)sysconf(_SC_PAGESIZE) : 0;
+}
+
+MemoryGovernor::Pressure MemoryGovernor::Sample() {
+  uint64_t rss = ReadRss();
+  Metrics::instance().process_rss_bytes.store(rss, std::memory_order_relaxed);
+
+  if (!budget_.rss_high_bytes || !rss)
+    pressure_ = Pressure::Low;
+  else if (rss >= budget_.rss_high_bytes)
+    pressure_ = Pressure::High;
+  else if (rss < budget_.rss_low_bytes)
+    pressure_ = Pressure::Low;
+  else
+    pressure_ = Pressure::Normal;
+  return pressure_;
+}
+
+bool MemoryGovernor::PurgeDue() const {
+  return pressure_ == Pressure::High &&
+         std::chrono::steady_clock::now() - last_purge_ >= kMinPurgeInterval;
+}
+
+void MemoryGovernor::RecordPurge() {
+  last_purge_ = std::chrono::steady_clock::now();
+  Metrics::instance().memory_purges.fetch_add(1, std::memory_order_relaxed);
+}
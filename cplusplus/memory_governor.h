@@ -0,0 +1,52 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+// Memory limits for one render process. Read before the renderer is created,
+// since the engine's cache sizes are fixed by its Config.
+struct MemoryBudget {
+  // RSS above which the engine is purged between jobs and idle views and
+  // surfaces are released. Defaults to 80% of the cgroup memory limit; 0
+  // turns the watermarks off, which counts as low pressure.
+  uint64_t rss_high_bytes = 0;
+  // RSS below which the view pool may grow back to its warm size.
+  uint64_t rss_low_bytes = 0;
+  // Config::memory_cache_size, Config::page_cache_size, Config::recycle_delay.
+  uint32_t memory_cache_bytes = 32u << 20;
+  uint32_t page_cache_size = 0;
+  double recycle_delay_seconds = 4.0;
+  // A view is destroyed instead of pooled after this many renders, so
+  // whatever it holds on to is released. 0 keeps views forever.
+  uint32_t view_max_renders = 1000;
+
+  // RENDER_RSS_HIGH_BYTES, RENDER_RSS_LOW_BYTES, RENDER_MEMORY_CACHE_BYTES,
+  // RENDER_PAGE_CACHE_SIZE, RENDER_RECYCLE_DELAY_S, RENDER_VIEW_MAX_RENDERS.
+  static MemoryBudget FromEnvironment();
+};
+
+// Watches process RSS against a MemoryBudget. Sampling reads /proc, so it is
+// cheap enough to run after every job.
+class MemoryGovernor {
+public:
+  enum class Pressure { Low, Normal, High };
+
+  static const std::chrono::seconds kMinPurgeInterval;
+
+  void set_budget(const MemoryBudget& budget) { budget_ = budget; }
+  const MemoryBudget& budget() const { return budget_; }
+
+  Pressure Sample();
+  Pressure pressure() const { return pressure_; }
+
+  // True above the high watermark, at most once per kMinPurgeInterval, so a
+  // working set that really is that large is not purged after every job.
+  bool PurgeDue() const;
+  void RecordPurge();
+
+  static uint64_t ReadRss();
+
+private:
+  MemoryBudget budget_;
+  Pressure pressure_ = Pressure::Low;
+  std::chrono::steady_clock::time_point last_purge_;
+};
@@ -0,0 +1,217 @@
+#include "metrics.h"
+#include "async_logger.h"
+#include <cstdio>
+
+static const double kPrometheusBounds[] = { 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+                                            0.25,  0.5,    1.0,   2.5,  5.0,   10.0, 30.0 };
+
+int LatencyHistogram::BucketFor(uint64_t micros) {
+  if (micros < 16)
+    return (int)micros;
+  int exponent = 63 - __builtin_clzll(micros);
+  int sub = (int)((micros >> (exponent - 3)) & 7);
+  int index = 16 + (exponent - 4) * 8 + sub;
+  return index < kBuckets ? index : kBuckets - 1;
+}
+
+uint64_t LatencyHistogram::BucketLow(int index) {
+  if (index < 16)
+    return index;
+  int exponent = 4 + (index - 16) / 8;
+  int sub = (index - 16) % 8;
+  return (uint64_t)(8 + sub) << (exponent - 3);
+}
+
+uint64_t LatencyHistogram::BucketHigh(int index) {
+  if (index < 16)
+    return index + 1;
+  int exponent = 4 + (index - 16) / 8;
+  int sub = (index - 16) % 8;
+  return (uint64_t)(9 + sub) << (exponent - 3);
+}
+
+void LatencyHistogram::Record(double seconds) {
+  uint64_t micros = seconds > 0 ? (uint64_t)(seconds * 1e6) : 0;
+  buckets_[BucketFor(micros)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_us_.fetch_add(micros, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::Quantile(double q) const {
+  uint64_t total = count();
+  if (total == 0)
+    return 0.0;
+
+  uint64_t rank = (uint64_t)(q * (total - 1)) + 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; i++) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen >= rank)
+      return (BucketLow(i) + BucketHigh(i)) / 2.0 / 1e6;
+  }
+  return BucketHigh(kBuckets - 1) / 1e6;
+}
+
+void LatencyHistogram::Reset() {
+  for (auto& bucket : buckets_)
+    bucket.store(0, std::memory_order_relaxed);
+  count_.store(0, std::memory_order_relaxed);
+  sum_us_.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::WritePrometheus(std::string& out, const char* name,
+                                       const char* labels) const {
+  char line[256];
+  uint64_t cumulative = 0;
+  int bucket = 0;
+  for (double bound : kPrometheusBounds) {
+    uint64_t bound_us = (uint64_t)(bound * 1e6);
+    while (bucket < kBuckets && BucketHigh(bucket) <= bound_us)
+      cumulative += buckets_[bucket++].load(std::memory_order_relaxed);
+    snprintf(line, sizeof(line), "%s_bucket{%s,le=\"%g\"} %llu\n", name, labels, bound,
+             (unsigned long long)cumulative);
+    out += line;
+  }
+
+  uint64_t total = count();
+  snprintf(line, sizeof(line), "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, labels,
+           (unsigned long long)total);
+  out += line;
+  snprintf(line, sizeof(line), "%s_sum{%s} %.6f\n", name, labels, sum());
+  out += line;
+  snprintf(line, sizeof(line), "%s_count{%s} %llu\n", name, labels, (unsigned long long)total);
+  out += line;
+}
+
+Metrics& Metrics::instance() {
+  static Metrics metrics;
+  return metrics;
+}
+
+void Metrics::RecordRender(const RenderTimings& timings, CacheStatus cache, bool ok) {
+  renders.fetch_add(1, std::memory_order_relaxed);
+  if (!ok)
+    failures.fetch_add(1, std::memory_order_relaxed);
+  pixels.fetch_add(timings.pixels, std::memory_order_relaxed);
+
+  switch (cache) {
+    case CacheStatus::MemoryHit: cache_memory_hits.fetch_add(1, std::memory_order_relaxed); break;
+    case CacheStatus::DiskHit: cache_disk_hits.fetch_add(1, std::memory_order_relaxed); break;
+    case CacheStatus::Coalesced: cache_coalesced.fetch_add(1, std::memory_order_relaxed); break;
+    case CacheStatus::Miss: cache_misses.fetch_add(1, std::memory_order_relaxed); break;
+  }
+
+  if (timings.started != RenderTimings::Clock::time_point())
+    queue.Record(RenderTimings::Between(timings.enqueued, timings.started) / 1e3);
+  if (timings.load_end != RenderTimings::Clock::time_point())
+    load.Record(RenderTimings::Between(timings.load_begin, timings.load_end) / 1e3);
+  if (timings.resize_end != RenderTimings::Clock::time_point())
+    resize.Record(RenderTimings::Between(timings.resize_begin, timings.resize_end) / 1e3);
+  if (timings.paint_end != RenderTimings::Clock::time_point())
+    paint.Record(RenderTimings::Between(timings.paint_begin, timings.paint_end) / 1e3);
+  if (timings.encode_end != RenderTimings::Clock::time_point())
+    encode.Record(RenderTimings::Between(timings.encode_begin, timings.encode_end) / 1e3);
+}
+
+static void WriteCounter(std::string& out, const char* name, const char* help, const char* labels,
+                         uint64_t value, bool header = true) {
+  char line[256];
+  if (header) {
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    out += line;
+  }
+  snprintf(line, sizeof(line), "%s%s %llu\n", name, labels, (unsigned long long)value);
+  out += line;
+}
+
+static void WriteGauge(std::string& out, const char* name, const char* help, const char* labels,
+                       double value, bool header = true) {
+  char line[256];
+  if (header) {
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s gauge\n", name, help, name);
+    out += line;
+  }
+  snprintf(line, sizeof(line), "%s%s %.17g\n", name, labels, value);
+  out += line;
+}
+
+std::string Metrics::Expose() const {
+  std::string out;
+  out.reserve(8192);
+
+  out += "# HELP htmltopng_phase_seconds Render latency per pipeline phase.\n";
+  out += "# TYPE htmltopng_phase_seconds histogram\n";
+  queue.WritePrometheus(out, "htmltopng_phase_seconds", "phase=\"queue\"");
+  load.WritePrometheus(out, "htmltopng_phase_seconds", "phase=\"load\"");
+  resize.WritePrometheus(out, "htmltopng_phase_seconds", "phase=\"resize\"");
+  paint.WritePrometheus(out, "htmltopng_phase_seconds", "phase=\"paint\"");
+  encode.WritePrometheus(out, "htmltopng_phase_seconds", "phase=\"encode\"");
+
+  auto relaxed = std::memory_order_relaxed;
+  WriteCounter(out, "htmltopng_renders_total", "Render requests handled.", "", renders.load(relaxed));
+  WriteCounter(out, "htmltopng_render_failures_total", "Render requests that failed.", "",
+               failures.load(relaxed));
+  WriteCounter(out, "htmltopng_render_timeouts_total", "Page loads that hit the load timeout.", "",
+               timeouts.load(relaxed));
+
+  WriteCounter(out, "htmltopng_rendered_pixels_total",
+               "Device pixels painted and encoded; scale 2 costs 4x scale 1.", "", pixels.load(relaxed));
+
+  WriteCounter(out, "htmltopng_cache_requests_total", "Result cache lookups by outcome.",
+               "{result=\"miss\"}", cache_misses.load(relaxed));
+  WriteCounter(out, "htmltopng_cache_requests_total", "", "{result=\"memory\"}",
+               cache_memory_hits.load(relaxed), false);
+  WriteCounter(out, "htmltopng_cache_requests_total", "", "{result=\"disk\"}",
+               cache_disk_hits.load(relaxed), false);
+  WriteCounter(out, "htmltopng_cache_requests_total", "", "{result=\"coalesced\"}",
+               cache_coalesced.load(relaxed), false);
+
+  WriteGauge(out, "htmltopng_queue_depth", "Jobs waiting for the render thread.", "",
+             (double)queue_depth.load(relaxed));
+  WriteGauge(out, "htmltopng_views", "Views owned by the renderer by state.", "{state=\"idle\"}",
+             (double)views_idle.load(relaxed));
+  WriteGauge(out, "htmltopng_views", "", "{state=\"busy\"}", (double)views_busy.load(relaxed), false);
+  WriteGauge(out, "htmltopng_views", "", "{state=\"template\"}",
+             (double)views_template.load(relaxed), false);
+  WriteGauge(out, "htmltopng_engine_memory_bytes",
+             "Engine memory as last reported by Renderer::LogMemoryUsage.", "",
+             (double)engine_memory_bytes.load(relaxed));
+  WriteCounter(out, "htmltopng_surface_allocations_total",
+               "Surface buffers taken from the idle pool (hit) or newly mapped (miss).", "{result=\"hit\"}",
+               surface_pool_hits.load(relaxed));
+  WriteCounter(out, "htmltopng_surface_allocations_total", "", "{result=\"miss\"}",
+               surface_pool_misses.load(relaxed), false);
+  WriteGauge(out, "htmltopng_surface_pool_idle_bytes", "Surface memory held for reuse.", "",
+             (double)surface_pool_idle_bytes.load(relaxed));
+  WriteGauge(out, "htmltopng_engine_heap_live_bytes", "Engine heap in use, via the allocator hooks.", "",
+             (double)engine_heap_live_bytes.load(relaxed));
+  WriteCounter(out, "htmltopng_engine_heap_allocated_bytes_total", "Engine heap bytes ever allocated.", "",
+               engine_heap_allocated_bytes.load(relaxed));
+  WriteGauge(out, "htmltopng_malloc_arena_bytes", "Memory the process malloc holds from the OS.", "",
+             (double)malloc_arena_bytes.load(relaxed));
+  WriteGauge(out, "htmltopng_malloc_free_bytes",
+             "Free memory inside malloc arenas; growth with flat live bytes is fragmentation.", "",
+             (double)malloc_free_bytes.load(relaxed));
+  WriteCounter(out, "htmltopng_malloc_trims_total", "Times free arena memory was returned to the OS.", "",
+               malloc_trims.load(relaxed));
+  WriteGauge(out, "htmltopng_process_rss_bytes", "Resident set size, sampled between jobs.", "",
+             (double)process_rss_bytes.load(relaxed));
+  WriteCounter(out, "htmltopng_memory_purges_total", "Times the memory governor purged the engine.", "",
+               memory_purges.load(relaxed));
+  WriteCounter(out, "htmltopng_views_recycled_total",
+               "Views destroyed instead of pooled, for age or memory pressure.", "", views_recycled.load(relaxed));
+  WriteCounter(out, "htmltopng_network_requests_total", "Remote fetches by network policy decision.",
+               "{result=\"allowed\"}", network_allowed.load(relaxed));
+  WriteCounter(out, "htmltopng_network_requests_total", "", "{result=\"blocked\"}",
+               network_blocked.load(relaxed), false);
+  WriteCounter(out, "htmltopng_network_budget_stops_total",
+               "Loads whose pending remote fetches were stopped when the fetch budget ran out.", "",
+               network_budget_stops.load(relaxed));
+
+  WriteCounter(out, "htmltopng_log_dropped_total", "Log messages dropped because the buffer was full.",
+               "", AsyncLogger::instance().dropped());
+  WriteCounter(out, "htmltopng_log_truncated_total", "Log messages cut to the maximum length.", "",
+               AsyncLogger::instance().truncated());
+
+  return out;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "render_cache.h"
+#include "timings.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Log-linear latency histogram in the spirit of HdrHistogram: 16 exact
+// buckets below 16us, then 8 sub-buckets per power of two (~12% relative
+// error). Recording is a single relaxed fetch_add, so it is safe from any
+// thread and never blocks.
+class LatencyHistogram {
+public:
+  static const int kBuckets = 16 + 37 * 8;
+
+  void Record(double seconds);
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  double sum() const { return sum_us_.load(std::memory_order_relaxed) / 1e6; }
+  double Quantile(double q) const;
+  void Reset();
+
+  void WritePrometheus(std::string& out, const char* name, const char* labels) const;
+
+private:
+  static int BucketFor(uint64_t micros);
+  static uint64_t BucketLow(int index);
+  static uint64_t BucketHigh(int index);
+
+  std::atomic<uint64_t> buckets_[kBuckets] = {};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_us_{0};
+};
+
+class Metrics {
+public:
+  static Metrics& instance();
+
+  LatencyHistogram queue;
+  LatencyHistogram load;
+  LatencyHistogram resize;
+  LatencyHistogram paint;
+  LatencyHistogram encode;
+
+  std::atomic<uint64_t> renders{0};
+  std::atomic<uint64_t> failures{0};
+  std::atomic<uint64_t> timeouts{0};
+  std::atomic<uint64_t> pixels{0};
+  std::atomic<uint64_t> cache_misses{0};
+  std::atomic<uint64_t> cache_memory_hits{0};
+  std::atomic<uint64_t> cache_disk_hits{0};
+  std::atomic<uint64_t> cache_coalesced{0};
+
+  std::atomic<int64_t> queue_depth{0};
+  std::atomic<int64_t> views_idle{0};
+  std::atomic<int64_t> views_busy{0};
+  std::atomic<int64_t> views_template{0};
+  std::atomic<uint64_t> engine_memory_bytes{0};
+  std::atomic<uint64_t> surface_pool_hits{0};
+  std::atomic<uint64_t> surface_pool_misses{0};
+  std::atomic<uint64_t> surface_pool_idle_bytes{0};
+  std::atomic<uint64_t> engine_heap_live_bytes{0};
+  std::atomic<uint64_t> engine_heap_allocated_bytes{0};
+  std::atomic<uint64_t> malloc_arena_bytes{0};
+  std::atomic<uint64_t> malloc_free_bytes{0};
+  std::atomic<uint64_t> malloc_trims{0};
+  std::atomic<uint64_t> process_rss_bytes{0};
+  std::atomic<uint64_t> memory_purges{0};
+  std::atomic<uint64_t> views_recycled{0};
+  std::atomic<uint64_t> network_allowed{0};
+  std::atomic<uint64_t> network_blocked{0};
+  std::atomic<uint64_t> network_budget_stops{0};
+
+  void RecordRender(const RenderTimings& timings, CacheStatus cache, bool ok);
+
+  // Text exposition format. Only reads atomics.
+  std::string Expose() const;
+};
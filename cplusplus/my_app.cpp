@@ -0,0 +1,1424 @@
+#include "my_app.h"
+#include "apng.h"
+#include "async_logger.h"
+#include "delta.h"
+#include "encoder_pool.h"
+#include "engine_heap.h"
+#include "metrics.h"
+#include "resample.h"
+#include "surface_pool.h"
+#include "trim.h"
+#include "tracer.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+
+using namespace ultralight;
+
+static const uint32_t kMaxAnimationFrames = 600;
+
+// Free malloc arena memory beyond this is returned to the OS when idle.
+static const uint64_t kMallocTrimThreshold = 64ull << 20;
+
+static const char* kDefaultWarmupHtml = R"(<!DOCTYPE html>
+<html>
+<head>
+<style>
+  body { font-family: Arial, sans-serif; margin: 24px; }
+  .row { display: flex; gap: 12px; }
+  .card { flex: 1; padding: 12px; border-radius: 8px; box-shadow: 0 2px 6px rgba(0,0,0,.2);
+          background: linear-gradient(135deg, #fafafa, #e0e0e0); }
+  table { border-collapse: collapse; width: 100%; }
+  td, th { border: 1px solid #ccc; padding: 4px 8px; }
+</style>
+</head>
+<body>
+  <h1>Warm-up</h1>
+  <p>The quick brown fox jumps over the lazy dog. <b>Bold</b> <i>italic</i> <code>mono</code></p>
+  <div class="row"><div class="card">One</div><div class="card">Two</div><div class="card">Three</div></div>
+  <table id="t"><tr><th>Key</th><th>Value</th></tr></table>
+  <svg width="120" height="60"><circle cx="30" cy="30" r="25" fill="#4caf50"/><rect x="70" y="10" width="40" height="40" fill="#2196f3"/></svg>
+  <canvas id="c" width="120" height="60"></canvas>
+  <script>
+    var t = document.getElementById('t');
+    for (var i = 0; i < 20; i++) {
+      var r = t.insertRow();
+      r.insertCell().textContent = 'row ' + i;
+      r.insertCell().textContent = JSON.stringify({ i: i, sq: i * i });
+    }
+    var ctx = document.getElementById('c').getContext('2d');
+    ctx.fillStyle = '#f44336';
+    ctx.fillRect(0, 0, 60, 60);
+  </script>
+</body>
+</html>)";
+
+static PlatformOptions g_platform_options;
+
+// Idle pools for more profiles than this are dropped, least recently used
+// first, so arbitrary user agents cannot grow the view count without bound.
+static const size_t kMaxViewPools = 8;
+
+std::string ViewProfile::Key() const {
+  std::string key;
+  key += enable_javascript ? 'j' : '-';
+  key += enable_images ? 'i' : '-';
+  key += is_transparent ? 't' : '-';
+  for (const std::string* field : { &font_family_standard, &font_family_fixed, &font_family_serif,
+                                    &font_family_sans_serif, &user_agent }) {
+    key += '\x1f';
+    key += *field;
+  }
+  return key;
+}
+
+void MyApp::set_platform_options(const PlatformOptions& options) {
+  g_platform_options = options;
+}
+
+void MyApp::set_timings(RenderTimings* timings) {
+  if (timings_)
+    EngineHeap::EndJob();
+  timings_ = timings;
+  if (timings_)
+    EngineHeap::BeginJob(timings_);
+}
+
+void MyApp::BeginPhase(const char* name, uint64_t RenderTimings::*heap_peak) {
+  AsyncLogger::SetPhase(name);
+  EngineHeap::BeginPhase(heap_peak);
+}
+
+MyApp::MyApp() {
+  bool heap_hooks = EngineHeap::Install();
+
+  std::string app_path = std::filesystem::current_path().string();
+  LogMessage(LogLevel::Info, "App Path: " + ultralight::String(app_path.c_str()));
+
+  const MemoryBudget& budget = g_platform_options.memory;
+  governor_.set_budget(budget);
+  network_default_ = g_platform_options.network;
+
+  Config config;
+  config.memory_cache_size = budget.memory_cache_bytes;
+  config.page_cache_size = budget.page_cache_size;
+  config.recycle_delay = budget.recycle_delay_seconds;
+  if (!g_platform_options.http_cache_path.empty())
+    config.cache_path = g_platform_options.http_cache_path.c_str();
+
+  Platform::instance().set_config(config);
+  Platform::instance().set_font_loader(g_platform_options.font_loader
+                                           ? g_platform_options.font_loader
+                                           : GetPlatformFontLoader());
+  Platform::instance().set_file_system(g_platform_options.file_system
+                                           ? g_platform_options.file_system
+                                           : GetPlatformFileSystem("./assets/"));
+  Platform::instance().set_logger(this);
+  if (!heap_hooks)
+    LogMessage(LogLevel::Info, "Engine allocator override not available; heap accounting is off");
+  Platform::instance().set_surface_factory(&SurfacePool::instance());
+
+  renderer_ = Renderer::Create();
+
+  pools_[ViewProfile().Key()].idle.push_back({ CreateView(1600, 800) });
+  UpdateViewGauges();
+}
+
+MyApp::~MyApp() {
+  view_ = nullptr;
+  templates_.clear();
+  pools_.clear();
+  renderer_ = nullptr;
+}
+
+RefPtr<View> MyApp::CreateView(uint32_t width, uint32_t height, const ViewProfile& profile,
+                               double scale) {
+  ViewConfig view_config;
+  view_config.initial_device_scale = scale;
+  view_config.is_accelerated = false;
+  view_config.enable_javascript = profile.enable_javascript;
+  view_config.enable_images = profile.enable_images;
+  view_config.is_transparent = profile.is_transparent;
+  if (!profile.font_family_standard.empty())
+    view_config.font_family_standard = profile.font_family_standard.c_str();
+  if (!profile.font_family_fixed.empty())
+    view_config.font_family_fixed = profile.font_family_fixed.c_str();
+  if (!profile.font_family_serif.empty())
+    view_config.font_family_serif = profile.font_family_serif.c_str();
+  if (!profile.font_family_sans_serif.empty())
+    view_config.font_family_sans_serif = profile.font_family_sans_serif.c_str();
+  if (!profile.user_agent.empty())
+    view_config.user_agent = profile.user_agent.c_str();
+
+  RefPtr<View> view = renderer_->CreateView(width, height, view_config, nullptr);
+  view->set_load_listener(this);
+  view->set_view_listener(this);
+  view->set_network_listener(this);
+  return view;
+}
+
+// Sizes the surface in device pixels. Pooled views switch scale in place;
+// every render loads new HTML anyway, so nothing needs to be reloaded.
+void MyApp::ApplyScale(View* view, uint32_t width, uint32_t height, double scale) {
+  uint32_t pixel_width = (uint32_t)std::ceil(width * scale);
+  uint32_t pixel_height = (uint32_t)std::ceil(height * scale);
+  if ((uint64_t)pixel_width * pixel_height > max_pixels_)
+    throw std::runtime_error("Requested surface of " + std::to_string(pixel_width) + "x" +
+                             std::to_string(pixel_height) + " pixels exceeds the limit");
+
+  if (view->device_scale() != scale)
+    view->set_device_scale(scale);
+  if (view->width() != pixel_width || view->height() != pixel_height)
+    view->Resize(pixel_width, pixel_height);
+}
+
+long MyApp::MeasureContentHeight(View* view) {
+  String exception;
+  String result = view->EvaluateScript(
+      "Math.max(document.documentElement.scrollHeight,"
+      " document.body ? document.body.scrollHeight : 0)",
+      &exception);
+  return exception.empty() ? strtol(result.utf8().data(), nullptr, 10) : 0;
+}
+
+// Measures the laid-out document and resizes the view once so the capture
+// covers it, without reloading. Clamped to max_full_page_height_ and to what
+// fits in max_pixels_.
+void MyApp::FitToContent(View* view, uint32_t width, uint32_t height, double scale) {
+  Mark(&RenderTimings::resize_begin);
+
+  long content_height = MeasureContentHeight(view);
+
+  uint64_t fit_height = std::min<uint64_t>(content_height > 0 ? content_height : 0,
+                                           max_full_page_height_);
+  uint64_t pixel_width = (uint64_t)std::ceil(width * scale);
+  if (pixel_width)
+    fit_height = std::min<uint64_t>(fit_height, (uint64_t)(max_pixels_ / pixel_width / scale));
+
+  if (fit_height > height) {
+    TraceScope trace("FitToContent");
+    ApplyScale(view, width, (uint32_t)fit_height, scale);
+    renderer_->Update();
+  }
+
+  Mark(&RenderTimings::resize_end);
+}
+
+static std::string JsStringLiteral(const std::string& value) {
+  std::string out = "\"";
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if ((unsigned char)c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+// Reads the viewport-relative border box of the first element matching
+// `selector` as left, top, width, height in CSS pixels.
+bool MyApp::MeasureElement(View* view, const std::string& selector, double box[4]) {
+  std::string script = "(function() { var e = document.querySelector(" + JsStringLiteral(selector) +
+                       "); if (!e) return ''; var r = e.getBoundingClientRect();"
+                       " return [r.left, r.top, r.width, r.height].join(','); })()";
+  String exception;
+  String result = view->EvaluateScript(String(script.c_str()), &exception);
+  if (!exception.empty())
+    throw std::runtime_error("Invalid selector: " + selector);
+
+  String8 text = result.utf8();
+  return sscanf(text.data(), "%lf,%lf,%lf,%lf", &box[0], &box[1], &box[2], &box[3]) == 4;
+}
+
+// Finds the element's box and grows the view once if the element extends past
+// its right or bottom edge, within the same limits as a full-page capture.
+// Returns the box in device pixels, clipped to the surface.
+PixelRect MyApp::FitToElement(View* view, const std::string& selector, double scale) {
+  Mark(&RenderTimings::resize_begin);
+
+  double box[4];
+  if (!MeasureElement(view, selector, box))
+    throw std::runtime_error("No element matches selector: " + selector);
+
+  uint32_t width = (uint32_t)std::lround(view->width() / scale);
+  uint32_t height = (uint32_t)std::lround(view->height() / scale);
+  uint32_t right = (uint32_t)std::min<double>(std::ceil(box[0] + box[2]), max_full_page_height_);
+  uint32_t bottom = (uint32_t)std::min<double>(std::ceil(box[1] + box[3]), max_full_page_height_);
+  if (right > width || bottom > height) {
+    TraceScope trace("FitToElement");
+    ApplyScale(view, std::max(width, right), std::max(height, bottom), scale);
+    renderer_->Update();
+    if (!MeasureElement(view, selector, box))
+      throw std::runtime_error("No element matches selector: " + selector);
+  }
+
+  Mark(&RenderTimings::resize_end);
+
+  double left = std::max(0.0, std::floor(box[0] * scale));
+  double top = std::max(0.0, std::floor(box[1] * scale));
+  double right_px = std::min<double>(std::ceil((box[0] + box[2]) * scale), view->width());
+  double bottom_px = std::min<double>(std::ceil((box[1] + box[3]) * scale), view->height());
+  if (right_px <= left || bottom_px <= top)
+    throw std::runtime_error("Element matching selector has no visible area: " + selector);
+
+  PixelRect rect;
+  rect.x = (uint32_t)left;
+  rect.y = (uint32_t)top;
+  rect.width = (uint32_t)(right_px - left);
+  rect.height = (uint32_t)(bottom_px - top);
+  return rect;
+}
+
+RefPtr<View> MyApp::AcquireView(uint32_t width, uint32_t height, const ViewProfile& profile,
+                                double scale) {
+  ViewPool& pool = pools_[profile.Key()];
+  pool.last_used = ++pool_clock_;
+
+  PooledView pooled;
+  if (pool.idle.empty()) {
+    pooled.view = CreateView(width, height, profile, scale);
+  } else {
+    pooled = pool.idle.back();
+    pool.idle.pop_back();
+  }
+
+  try {
+    ApplyScale(pooled.view.get(), width, height, scale);
+  } catch (...) {
+    pool.idle.push_back(pooled);
+    throw;
+  }
+
+  RefPtr<View> view = pooled.view;
+  busy_renders_[view.get()] = pooled.renders;
+  busy_views_++;
+  UpdateViewGauges();
+  return view;
+}
+
+// Views go back to their pool unless they have reached the budget's render
+// limit or the pool already holds enough idle views for the current memory
+// pressure; dropped views are destroyed with everything they reference.
+void MyApp::ReleaseView(RefPtr<View> view, const ViewProfile& profile) {
+  uint32_t renders = 1;
+  auto busy = busy_renders_.find(view.get());
+  if (busy != busy_renders_.end()) {
+    renders += busy->second;
+    busy_renders_.erase(busy);
+  }
+  busy_views_--;
+
+  ViewPool& pool = pools_[profile.Key()];
+  uint32_t max_renders = governor_.budget().view_max_renders;
+  size_t max_idle = governor_.pressure() == MemoryGovernor::Pressure::High ? 1 : warm_views_;
+  if ((max_renders && renders >= max_renders) || pool.idle.size() >= max_idle)
+    Metrics::instance().views_recycled.fetch_add(1, std::memory_order_relaxed);
+  else
+    pool.idle.push_back({ view, renders });
+
+  while (pools_.size() > kMaxViewPools) {
+    auto oldest = pools_.begin();
+    for (auto it = pools_.begin(); it != pools_.end(); ++it) {
+      if (it->second.last_used < oldest->second.last_used)
+        oldest = it;
+    }
+    pools_.erase(oldest);
+  }
+
+  UpdateViewGauges();
+}
+
+void MyApp::UpdateViewGauges() {
+  size_t idle = 0;
+  for (const auto& pool : pools_)
+    idle += pool.second.idle.size();
+
+  Metrics& metrics = Metrics::instance();
+  metrics.views_idle.store(idle, std::memory_order_relaxed);
+  metrics.views_busy.store(busy_views_, std::memory_order_relaxed);
+  metrics.views_template.store(templates_.size(), std::memory_order_relaxed);
+}
+
+// Releases what the engine and the pools hold without dropping the views
+// needed for the next render.
+void MyApp::PurgeMemory() {
+  TraceScope trace("PurgeMemory");
+  uint64_t before = MemoryGovernor::ReadRss();
+
+  for (auto& pool : pools_) {
+    if (pool.second.idle.size() > 1)
+      pool.second.idle.resize(1);
+  }
+  UpdateViewGauges();
+  renderer_->PurgeMemory();
+  SurfacePool::instance().ReleaseIdle();
+  EngineHeap::TrimMalloc();
+
+  governor_.RecordPurge();
+  purged_since_job_ = true;
+  LogMessage(LogLevel::Info, String(("Purged memory, RSS " + std::to_string(before >> 20) + " MB -> " +
+                                     std::to_string(MemoryGovernor::ReadRss() >> 20) + " MB").c_str()));
+}
+
+void MyApp::AfterJob() {
+  purged_since_job_ = false;
+  governor_.Sample();
+  if (governor_.PurgeDue())
+    PurgeMemory();
+}
+
+void MyApp::OnIdle() {
+  // Idle time is the cheapest time to purge, so anything above the low
+  // watermark is released once per busy period. Below it the default pool
+  // is refilled to its warm size.
+  MemoryGovernor::Pressure pressure = governor_.Sample();
+  if (pressure != MemoryGovernor::Pressure::Low && !purged_since_job_) {
+    PurgeMemory();
+  } else if (pressure == MemoryGovernor::Pressure::Low) {
+    std::vector<PooledView>& idle = pools_[ViewProfile().Key()].idle;
+    if (idle.size() < warm_views_) {
+      while (idle.size() < warm_views_)
+        idle.push_back({ CreateView(1600, 800) });
+      UpdateViewGauges();
+    }
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  if (now - last_memory_sample_ >= std::chrono::seconds(10)) {
+    last_memory_sample_ = now;
+    SampleEngineMemory();
+    EngineHeap::SampleFragmentation(kMallocTrimThreshold);
+  }
+}
+
+// Renderer::LogMemoryUsage() reports through the Logger, so its output is
+// captured here and the total is pulled out of lines like "... 12.5 MB".
+// Lines mentioning "total" win; otherwise all reported sizes are summed.
+static uint64_t ParseMemoryLog(const std::string& log) {
+  uint64_t total = 0;
+  uint64_t sum = 0;
+
+  size_t line_start = 0;
+  while (line_start < log.size()) {
+    size_t line_end = log.find('\n', line_start);
+    if (line_end == std::string::npos)
+      line_end = log.size();
+    std::string line = log.substr(line_start, line_end - line_start);
+    line_start = line_end + 1;
+
+    std::string lower = line;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c){ return std::tolower(c); });
+
+    for (size_t i = 0; i < line.size(); i++) {
+      if (!isdigit((unsigned char)line[i]) || (i > 0 && (isalnum((unsigned char)line[i - 1]) || line[i - 1] == '.')))
+        continue;
+
+      char* end = nullptr;
+      double value = strtod(line.c_str() + i, &end);
+      size_t unit = end - line.c_str();
+      while (unit < line.size() && line[unit] == ' ')
+        unit++;
+
+      double scale = 0;
+      if (lower.compare(unit, 2, "gb") == 0 || lower.compare(unit, 3, "gib") == 0)
+        scale = 1024.0 * 1024.0 * 1024.0;
+      else if (lower.compare(unit, 2, "mb") == 0 || lower.compare(unit, 3, "mib") == 0)
+        scale = 1024.0 * 1024.0;
+      else if (lower.compare(unit, 2, "kb") == 0 || lower.compare(unit, 3, "kib") == 0)
+        scale = 1024.0;
+      else if (lower.compare(unit, 5, "bytes") == 0)
+        scale = 1.0;
+
+      i = end - line.c_str();
+      if (scale == 0)
+        continue;
+
+      uint64_t bytes = (uint64_t)(value * scale);
+      if (lower.find("total") != std::string::npos) {
+        total = bytes;
+        break;
+      }
+      sum += bytes;
+    }
+  }
+
+  return total ? total : sum;
+}
+
+void MyApp::SampleEngineMemory() {
+  memory_log_.clear();
+  capturing_memory_log_ = true;
+  renderer_->LogMemoryUsage();
+  capturing_memory_log_ = false;
+
+  uint64_t bytes = ParseMemoryLog(memory_log_);
+  if (bytes)
+    Metrics::instance().engine_memory_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+void MyApp::Warmup(const WarmupOptions& options) {
+  LogMessage(LogLevel::Info, "Starting Warmup()...");
+
+  load_timeout_ms_ = options.load_timeout_ms;
+  max_pixels_ = options.max_pixels;
+  max_full_page_height_ = options.max_full_page_height;
+  SurfacePool::instance().set_max_idle_bytes(options.surface_pool_bytes);
+
+  ViewProfile static_profile;
+  static_profile.enable_javascript = false;
+
+  warm_views_ = std::max<uint32_t>(options.views, 1);
+  std::vector<PooledView>& idle = pools_[ViewProfile().Key()].idle;
+  while (idle.size() < warm_views_)
+    idle.push_back({ CreateView(1600, 800) });
+  pools_[static_profile.Key()].idle.push_back({ CreateView(1600, 800, static_profile) });
+  UpdateViewGauges();
+
+  if (!options.fonts.empty()) {
+    std::string probe = "<html><body>";
+    for (const auto& family : options.fonts) {
+      std::string style = "font-family: '" + family + "';";
+      std::string sample = "The quick brown fox jumps over the lazy dog 0123456789";
+      probe += "<p style=\"" + style + "\">" + sample + "</p>";
+      probe += "<p style=\"" + style + " font-weight: bold;\">" + sample + "</p>";
+      probe += "<p style=\"" + style + " font-style: italic;\">" + sample + "</p>";
+    }
+    probe += "</body></html>";
+    Run(String(probe.c_str()));
+  }
+
+  // The corpus also goes through the JavaScript-disabled profile used by
+  // the static fast path.
+  if (options.html.empty()) {
+    Run(String(kDefaultWarmupHtml));
+    Run(String(kDefaultWarmupHtml), 1600, 800, static_profile);
+  } else {
+    for (const auto& html : options.html) {
+      Run(String(html.c_str()));
+      Run(String(html.c_str()), 1600, 800, static_profile);
+    }
+  }
+
+  LogMessage(LogLevel::Info, "Warmup() finished, renderer is ready.");
+}
+
+void MyApp::LoadAndWait(RefPtr<View> view, const String& html_string) {
+  view_ = view;
+
+  BeginPhase("load", &RenderTimings::heap_peak_load);
+  Mark(&RenderTimings::load_begin);
+  load_started_ = std::chrono::steady_clock::now();
+  loading_ = true;
+  dom_ready_ = false;
+  remote_fetches_ = 0;
+
+  {
+    TraceScope trace("LoadHTML");
+    view_->LoadHTML(html_string);
+  }
+  LogMessage(LogLevel::Info, "Html String loaded into the View.");
+
+  auto deadline = load_started_ + std::chrono::milliseconds(load_timeout_ms_);
+  auto budget_deadline = load_started_ + std::chrono::milliseconds(RemoteBudgetMs());
+  bool budget_spent = false;
+
+  done_ = false;
+  do {
+    {
+      TraceScope trace("Update");
+      renderer_->Update();
+    }
+    if (timings_)
+      timings_->update_iterations++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // Slow remote fetches hold up the load event. Once the budget is spent
+    // they are stopped and the page is captured without them.
+    auto now = std::chrono::steady_clock::now();
+    if (!done_ && !budget_spent && remote_fetches_ && RemoteBudgetMs() && now >= budget_deadline) {
+      view_->Stop();
+      budget_spent = true;
+      Metrics::instance().network_budget_stops.fetch_add(1, std::memory_order_relaxed);
+      LogMessage(LogLevel::Warning, "Remote fetch budget spent; stopped pending requests");
+    }
+    if (budget_spent && dom_ready_)
+      done_ = true;
+
+    if (!done_ && now >= deadline) {
+      view_->Stop();
+      view_ = nullptr;
+      loading_ = false;
+      throw RenderTimeoutError("Timed out waiting for the page to load");
+    }
+  } while (!done_);
+
+  loading_ = false;
+  Mark(&RenderTimings::load_end);
+}
+
+void MyApp::Paint(View* view) {
+  if (timings_)
+    timings_->pixels = (uint64_t)view->width() * view->height();
+
+  BeginPhase("paint", &RenderTimings::heap_peak_paint);
+  Mark(&RenderTimings::paint_begin);
+  {
+    TraceScope trace("Render");
+    renderer_->RefreshDisplay(0);
+    renderer_->Render();
+  }
+  Mark(&RenderTimings::paint_end);
+}
+
+// Scrolls the band-sized view down the page and feeds each band's rows to a
+// streaming encoder, so peak memory depends on the band, not the page
+// height. Paint and encode are interleaved, so their phases overlap.
+void MyApp::CaptureTiled(View* view, uint32_t height, bool alpha, const CaptureOptions& capture,
+                         const PngStreamEncoder::Sink& sink) {
+  uint32_t total_height = height;
+  if (capture.full_page) {
+    Mark(&RenderTimings::resize_begin);
+    long content_height = MeasureContentHeight(view);
+    total_height = std::max<uint32_t>(height, (uint32_t)std::max<long>(content_height, 0));
+    Mark(&RenderTimings::resize_end);
+  }
+  total_height = std::min(total_height, max_full_page_height_);
+
+  // Lets the last band scroll into place when the requested height is
+  // taller than the document.
+  view->EvaluateScript(String(("document.documentElement.style.minHeight = '" +
+                               std::to_string(total_height) + "px'").c_str()));
+
+  uint32_t pixel_width = view->width();
+  uint32_t surface_height = view->height();
+  uint32_t total_rows = (uint32_t)std::ceil(total_height * capture.scale);
+  if (timings_)
+    timings_->pixels = (uint64_t)pixel_width * total_rows;
+
+  BeginPhase("paint", &RenderTimings::heap_peak_paint);
+  Mark(&RenderTimings::paint_begin);
+  Mark(&RenderTimings::encode_begin);
+
+  PngStreamEncoder encoder(pixel_width, total_rows, alpha, Z_DEFAULT_COMPRESSION, sink);
+  while (encoder.rows_written() < total_rows) {
+    TraceScope trace("Band");
+    uint32_t row = encoder.rows_written();
+
+    std::string scroll = "window.scrollTo(0, " + std::to_string((long)(row / capture.scale)) +
+                         "); window.scrollY";
+    String scrolled = view->EvaluateScript(String(scroll.c_str()));
+    long scroll_y = strtol(scrolled.utf8().data(), nullptr, 10);
+
+    renderer_->Update();
+    renderer_->RefreshDisplay(0);
+    renderer_->Render();
+
+    uint32_t first_row = (uint32_t)std::lround(scroll_y * capture.scale);
+    if (first_row > row || row - first_row >= surface_height)
+      throw std::runtime_error("Tiled capture could not scroll to row " + std::to_string(row));
+
+    uint32_t offset = row - first_row;
+    uint32_t count = std::min(surface_height - offset, total_rows - row);
+
+    SurfaceLock pixels(view->surface());
+    encoder.WriteBgraRows(pixels.at(0, offset), pixels.row_bytes(), count);
+  }
+  Mark(&RenderTimings::paint_end);
+
+  BeginPhase("encode", &RenderTimings::heap_peak_encode);
+  encoder.Finish();
+  Mark(&RenderTimings::encode_end);
+}
+
+static void DeletePngBytes(void* user_data, void* data) {
+  delete static_cast<std::vector<uint8_t>*>(user_data);
+}
+
+static PixelRect WholeSurface(View* view) {
+  PixelRect rect;
+  rect.width = view->width();
+  rect.height = view->height();
+  return rect;
+}
+
+PixelRect MyApp::TrimToContent(View* view, PixelRect rect) {
+  TraceScope trace("Trim");
+  SurfaceLock pixels(view->surface());
+  TrimUniformBorders(pixels.data(), pixels.row_bytes(),
+                     &rect.x, &rect.y, &rect.width, &rect.height);
+  return rect;
+}
+
+// Paints, then encodes only `rect` straight from the locked surface, so the
+// encode cost follows the rect's area. A trimmed rect's position is stored in
+// the PNG as an oFFs chunk.
+RefPtr<Buffer> MyApp::CaptureRegion(View* view, PixelRect rect, bool trim, bool alpha) {
+  Paint(view);
+  if (trim)
+    rect = TrimToContent(view, rect);
+
+  BeginPhase("encode", &RenderTimings::heap_peak_encode);
+  Mark(&RenderTimings::encode_begin);
+  auto png = std::make_unique<std::vector<uint8_t>>();
+  {
+    TraceScope trace("EncodeRegion");
+    SurfaceLock pixels(view->surface());
+
+    PngStreamEncoder encoder(rect.width, rect.height, alpha, Z_DEFAULT_COMPRESSION,
+                             [&png](const uint8_t* data, size_t size) { png->insert(png->end(), data, data + size); });
+    if (trim)
+      encoder.WriteOffset((int32_t)rect.x, (int32_t)rect.y);
+    encoder.WriteBgraRows(pixels.at(rect.x, rect.y), pixels.row_bytes(), rect.height);
+    encoder.Finish();
+  }
+  Mark(&RenderTimings::encode_end);
+
+  std::vector<uint8_t>* bytes = png.release();
+  return Buffer::Create(bytes->data(), bytes->size(), bytes, DeletePngBytes);
+}
+
+// Paints once, then resamples and encodes every requested size in parallel
+// on the EncoderPool straight from the locked surface. The RenderThread waits
+// for the pool, so the surface cannot change underneath it.
+void MyApp::CaptureSizes(View* view, PixelRect rect, bool trim, bool alpha,
+                         const std::vector<OutputSize>& sizes) {
+  Paint(view);
+  if (trim)
+    rect = TrimToContent(view, rect);
+
+  BeginPhase("encode", &RenderTimings::heap_peak_encode);
+  Mark(&RenderTimings::encode_begin);
+  uint32_t src_width = rect.width;
+  uint32_t src_height = rect.height;
+
+  std::vector<std::unique_ptr<std::vector<uint8_t>>> pngs(sizes.size());
+  {
+    SurfaceLock pixels(view->surface());
+    const uint8_t* src = pixels.at(rect.x, rect.y);
+    uint32_t src_row_bytes = pixels.row_bytes();
+
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < sizes.size(); i++) {
+      uint32_t width = sizes[i].width;
+      uint32_t height = sizes[i].height;
+      if (!height)
+        height = std::max<uint32_t>(1, (uint32_t)std::lround((double)width * src_height / src_width));
+      if (!width || (uint64_t)width * height > max_pixels_)
+        throw std::runtime_error("Output size " + std::to_string(width) + "x" + std::to_string(height) +
+                                 " is empty or exceeds maxPixels");
+
+      pngs[i] = std::make_unique<std::vector<uint8_t>>();
+      std::vector<uint8_t>* png = pngs[i].get();
+      tasks.push_back([=] {
+        TraceScope trace("EncodeSize");
+        PngStreamEncoder::Sink sink = [png](const uint8_t* data, size_t size) {
+          png->insert(png->end(), data, data + size);
+        };
+        PngStreamEncoder encoder(width, height, alpha, Z_DEFAULT_COMPRESSION, sink);
+        if (width == src_width && height == src_height) {
+          encoder.WriteBgraRows(src, src_row_bytes, height);
+        } else {
+          std::vector<uint8_t> resized((size_t)width * height * 4);
+          {
+            TraceScope trace("Resample");
+            ResampleBgra(src, src_width, src_height, src_row_bytes, resized.data(), width, height, width * 4);
+          }
+          encoder.WriteBgraRows(resized.data(), width * 4, height);
+        }
+        encoder.Finish();
+      });
+    }
+    EncoderPool::instance().RunAll(std::move(tasks));
+  }
+  Mark(&RenderTimings::encode_end);
+
+  for (auto& png : pngs) {
+    std::vector<uint8_t>* bytes = png.release();
+    outputs_->push_back(Buffer::Create(bytes->data(), bytes->size(), bytes, DeletePngBytes));
+  }
+}
+
+// Lays the loaded page out again at each viewport, without reloading, and
+// paints it. Each frame is copied off the surface, which the next resize
+// reallocates, and encoded on the EncoderPool while the next viewport is laid
+// out, so paint and encode overlap.
+void MyApp::CaptureViewports(View* view, uint32_t height, bool alpha, const CaptureOptions& capture) {
+  BeginPhase("paint", &RenderTimings::heap_peak_paint);
+  Mark(&RenderTimings::paint_begin);
+
+  std::vector<std::unique_ptr<std::vector<uint8_t>>> pngs;
+  std::vector<std::future<void>> encodes;
+  uint64_t pixels = 0;
+  try {
+    for (const Viewport& viewport : capture.viewports) {
+      uint32_t viewport_height = viewport.height ? viewport.height : height;
+      {
+        TraceScope trace("Relayout");
+        ApplyScale(view, viewport.width, viewport_height, capture.scale);
+        renderer_->Update();
+      }
+      if (capture.full_page)
+        FitToContent(view, viewport.width, viewport_height, capture.scale);
+      {
+        TraceScope trace("Render");
+        renderer_->RefreshDisplay(0);
+        renderer_->Render();
+      }
+
+      uint32_t frame_width = view->width();
+      uint32_t frame_height = view->height();
+      auto frame = std::make_shared<std::vector<uint8_t>>((size_t)frame_width * frame_height * 4);
+      {
+        TraceScope trace("CopyFrame");
+        SurfaceLock locked(view->surface());
+        for (uint32_t y = 0; y < frame_height; y++)
+          memcpy(frame->data() + (size_t)y * frame_width * 4, locked.at(0, y), (size_t)frame_width * 4);
+      }
+      pixels += (uint64_t)frame_width * frame_height;
+
+      if (encodes.empty())
+        Mark(&RenderTimings::encode_begin);
+      pngs.push_back(std::make_unique<std::vector<uint8_t>>());
+      std::vector<uint8_t>* png = pngs.back().get();
+      encodes.push_back(EncoderPool::instance().Submit([=] {
+        TraceScope trace("EncodeViewport");
+        PngStreamEncoder encoder(frame_width, frame_height, alpha, Z_DEFAULT_COMPRESSION,
+                                 [png](const uint8_t* data, size_t size) { png->insert(png->end(), data, data + size); });
+        encoder.WriteBgraRows(frame->data(), frame_width * 4, frame_height);
+        encoder.Finish();
+      }));
+    }
+  } catch (...) {
+    // The queued encodes write into `pngs`.
+    for (auto& encode : encodes)
+      encode.wait();
+    throw;
+  }
+  Mark(&RenderTimings::paint_end);
+
+  BeginPhase("encode", &RenderTimings::heap_peak_encode);
+  for (auto& encode : encodes)
+    encode.wait();
+  for (auto& encode : encodes)
+    encode.get();
+  Mark(&RenderTimings::encode_end);
+
+  if (timings_)
+    timings_->pixels = pixels;
+  for (auto& png : pngs) {
+    std::vector<uint8_t>* bytes = png.release();
+    outputs_->push_back(Buffer::Create(bytes->data(), bytes->size(), bytes, DeletePngBytes));
+  }
+}
+
+// Pauses every CSS animation and transition and moves it to `time_ms`, so
+// frames depend on virtual time rather than on how long rendering takes.
+// Script-driven animations (requestAnimationFrame, timers) are not stepped.
+void MyApp::SeekAnimations(View* view, double time_ms) {
+  std::string script = "document.getAnimations().forEach(function(a) { a.pause(); a.currentTime = " +
+                       std::to_string(time_ms) + "; })";
+  String exception;
+  view->EvaluateScript(String(script.c_str()), &exception);
+  if (!exception.empty())
+    throw std::runtime_error("Could not step animations: " + std::string(exception.utf8().data()));
+}
+
+// Steps virtual time and paints one frame per step. Steps that leave the
+// surface's dirty bounds empty only extend the previous frame, and later
+// frames cover just the dirty rectangle. Each frame is copied off the surface
+// and compressed on the EncoderPool while the next one is produced.
+RefPtr<Buffer> MyApp::CaptureAnimation(View* view, bool alpha, const CaptureOptions& capture) {
+  uint32_t fps = std::min<uint32_t>(std::max<uint32_t>(capture.animation_fps, 1), 60);
+  uint32_t steps = (uint32_t)std::lround((double)capture.animation_duration_ms * fps / 1000.0);
+  steps = std::min(std::max<uint32_t>(steps, 1), kMaxAnimationFrames);
+
+  Surface* surface = view->surface();
+  uint32_t width = view->width();
+  uint32_t height = view->height();
+  if (timings_)
+    timings_->pixels = (uint64_t)width * height;
+
+  BeginPhase("paint", &RenderTimings::heap_peak_paint);
+  Mark(&RenderTimings::paint_begin);
+
+  std::vector<std::unique_ptr<ApngFrame>> frames;
+  std::vector<std::future<void>> encodes;
+  try {
+    for (uint32_t step = 0; step < steps; step++) {
+      TraceScope trace("Frame");
+      SeekAnimations(view, step * 1000.0 / fps);
+      renderer_->Update();
+      renderer_->RefreshDisplay(0);
+      renderer_->Render();
+
+      IntRect dirty = surface->dirty_bounds().Intersect(IntRect{ 0, 0, (int)width, (int)height });
+      surface->ClearDirtyBounds();
+      if (step == 0) {
+        dirty = IntRect{ 0, 0, (int)width, (int)height };
+      } else if (!dirty.IsValid()) {
+        frames.back()->delay_num++;
+        continue;
+      }
+
+      auto frame = std::make_unique<ApngFrame>();
+      frame->x = dirty.left;
+      frame->y = dirty.top;
+      frame->width = dirty.width();
+      frame->height = dirty.height();
+      frame->delay_den = (uint16_t)fps;
+
+      size_t frame_row_bytes = (size_t)frame->width * 4;
+      auto pixels = std::make_shared<std::vector<uint8_t>>(frame_row_bytes * frame->height);
+      {
+        SurfaceLock locked(surface);
+        for (uint32_t y = 0; y < frame->height; y++)
+          memcpy(pixels->data() + y * frame_row_bytes, locked.at(frame->x, frame->y + y), frame_row_bytes);
+      }
+
+      if (encodes.empty())
+        Mark(&RenderTimings::encode_begin);
+      ApngFrame* target = frame.get();
+      frames.push_back(std::move(frame));
+      encodes.push_back(EncoderPool::instance().Submit([=] {
+        TraceScope trace("CompressFrame");
+        target->data = CompressPngFrame(pixels->data(), (uint32_t)frame_row_bytes, target->width,
+                                        target->height, alpha, Z_DEFAULT_COMPRESSION);
+      }));
+    }
+  } catch (...) {
+    // The queued compressions write into `frames`.
+    for (auto& encode : encodes)
+      encode.wait();
+    throw;
+  }
+  Mark(&RenderTimings::paint_end);
+
+  BeginPhase("encode", &RenderTimings::heap_peak_encode);
+  for (auto& encode : encodes)
+    encode.wait();
+  for (auto& encode : encodes)
+    encode.get();
+
+  std::vector<ApngFrame> ordered;
+  for (auto& frame : frames)
+    ordered.push_back(std::move(*frame));
+  auto png = std::make_unique<std::vector<uint8_t>>();
+  {
+    TraceScope trace("WriteApng");
+    WriteApng(width, height, alpha, 0, ordered,
+              [&png](const uint8_t* data, size_t size) { png->insert(png->end(), data, data + size); });
+  }
+  Mark(&RenderTimings::encode_end);
+
+  std::vector<uint8_t>* bytes = png.release();
+  return Buffer::Create(bytes->data(), bytes->size(), bytes, DeletePngBytes);
+}
+
+const char* CaptureOptionsError(const CaptureOptions& capture, bool streaming) {
+  bool banded = streaming || capture.tile_height;
+  bool animated = capture.animation_duration_ms > 0;
+  if ((int)banded + (int)!capture.sizes.empty() + (int)!capture.viewports.empty() + (int)animated > 1)
+    return "Only one of tiled, streaming, output sizes, viewports or animated capture can be used";
+  if ((!capture.selector.empty() || capture.trim) && (banded || !capture.viewports.empty() || animated))
+    return "A selector or trim can only be combined with output sizes";
+  return nullptr;
+}
+
+// The bindings reject bad combinations up front; this guards other callers
+// before a view is acquired or anything is loaded.
+static void CheckCaptureOptions(const CaptureOptions& capture, bool streaming, bool has_outputs) {
+  if ((!capture.sizes.empty() || !capture.viewports.empty()) && !has_outputs)
+    throw std::runtime_error("Output sizes and viewports need an output list");
+  if (const char* error = CaptureOptionsError(capture, streaming))
+    throw std::runtime_error(error);
+}
+
+RefPtr<Buffer> MyApp::LoadAndCapture(const String& html_string, uint32_t width, uint32_t height,
+                                     const ViewProfile& profile, const CaptureOptions& capture) {
+  CheckCaptureOptions(capture, stream_sink_ != nullptr, outputs_ != nullptr);
+
+  uint32_t view_width = width;
+  uint32_t view_height = capture.tile_height ? std::min({ height, capture.tile_height, max_full_page_height_ })
+                                             : height;
+  if (!capture.viewports.empty()) {
+    // Load at the first viewport so it needs no relayout.
+    view_width = capture.viewports[0].width;
+    view_height = capture.viewports[0].height ? capture.viewports[0].height : height;
+  }
+  RefPtr<View> view = AcquireView(view_width, view_height, profile, capture.scale);
+
+  RefPtr<Buffer> buffer;
+  try {
+    LoadAndWait(view, html_string);
+
+    if (capture.animation_duration_ms) {
+      if (capture.full_page)
+        FitToContent(view.get(), width, height, capture.scale);
+      buffer = CaptureAnimation(view.get(), profile.is_transparent, capture);
+    } else if (!capture.viewports.empty()) {
+      CaptureViewports(view.get(), height, profile.is_transparent, capture);
+    } else if (stream_sink_) {
+      CaptureTiled(view.get(), height, profile.is_transparent, capture, *stream_sink_);
+    } else if (capture.tile_height) {
+      auto png = std::make_unique<std::vector<uint8_t>>();
+      CaptureTiled(view.get(), height, profile.is_transparent, capture,
+                   [&png](const uint8_t* data, size_t size) { png->insert(png->end(), data, data + size); });
+      buffer = Buffer::Create(png->data(), png->size(), png.get(), DeletePngBytes);
+      png.release();
+    } else {
+      if (capture.full_page)
+        FitToContent(view.get(), width, height, capture.scale);
+      PixelRect rect = capture.selector.empty() ? WholeSurface(view.get())
+                                                : FitToElement(view.get(), capture.selector, capture.scale);
+      if (!capture.sizes.empty())
+        CaptureSizes(view.get(), rect, capture.trim, profile.is_transparent, capture.sizes);
+      else
+        buffer = CaptureRegion(view.get(), rect, capture.trim, profile.is_transparent);
+    }
+  } catch (...) {
+    ReleaseView(view, profile);
+    view_ = nullptr;
+    throw;
+  }
+
+  ReleaseView(view, profile);
+  view_ = nullptr;
+
+  return buffer;
+}
+
+RefPtr<Buffer> MyApp::Run(const String& html_string, uint32_t width, uint32_t height,
+                          const ViewProfile& profile, const CaptureOptions& capture) {
+  LogMessage(LogLevel::Info, "Starting Run(), waiting for page to load...");
+
+  useLocalImages_ = false;
+
+  RefPtr<Buffer> buffer = LoadAndCapture(html_string, width, height, profile, capture);
+
+  LogMessage(LogLevel::Info, "Saved a render of our page to result.png.");
+
+  return buffer;
+}
+
+RefPtr<Buffer> MyApp::RunWithImages(const String& html_string,
+                                    const std::map<std::string, std::string>& imagePaths,
+                                    uint32_t width,
+                                    uint32_t height,
+                                    const ViewProfile& profile,
+                                    const CaptureOptions& capture) {
+  LogMessage(LogLevel::Info, "Starting RunWithImages(), waiting for page to load...");
+
+  imagePaths_ = imagePaths;
+  useLocalImages_ = true;
+
+  String modified_html = PreprocessHtml(html_string);
+
+  RefPtr<Buffer> buffer = LoadAndCapture(modified_html, width, height, profile, capture);
+
+  LogMessage(LogLevel::Info, "Saved a render of our page with images to result.png.");
+
+  return buffer;
+}
+
+void MyApp::RegisterTemplate(const std::string& id, const String& html_string,
+                             uint32_t width, uint32_t height, const ViewProfile& profile) {
+  LogMessage(LogLevel::Info, "Registering template: " + String(id.c_str()));
+
+  ViewProfile template_profile = profile;
+  template_profile.enable_javascript = true;
+  RefPtr<View> view = CreateView(width, height, template_profile);
+  LoadAndWait(view, html_string);
+  view_ = nullptr;
+
+  TemplateView entry;
+  entry.view = view;
+  entry.alpha = template_profile.is_transparent;
+  templates_[id] = std::move(entry);
+  UpdateViewGauges();
+}
+
+bool MyApp::UnregisterTemplate(const std::string& id) {
+  bool removed = templates_.erase(id) > 0;
+  UpdateViewGauges();
+  return removed;
+}
+
+static std::string JSValueToStdString(JSContextRef ctx, JSValueRef value) {
+  JSStringRef str = JSValueToStringCopy(ctx, value, nullptr);
+  if (!str)
+    return "";
+  std::string out(JSStringGetMaximumUTF8CStringSize(str), '\0');
+  out.resize(JSStringGetUTF8CString(str, &out[0], out.size()) - 1);
+  JSStringRelease(str);
+  return out;
+}
+
+static void DeleteTemplateBytes(void* bytes, void* deallocator_context) {
+  delete static_cast<std::vector<uint8_t>*>(deallocator_context);
+}
+
+// Resizes the template's view, calls render(data) and waits, up to the load
+// timeout, for anything it started loading.
+RefPtr<View> MyApp::ApplyTemplateData(const std::string& id, const std::string& json,
+                                      std::vector<TemplateBinary> binaries, uint32_t width,
+                                      uint32_t height, double scale) {
+  auto it = templates_.find(id);
+  if (it == templates_.end())
+    throw std::runtime_error("Unknown template: " + id);
+
+  // A width or height of 0 keeps the template's current CSS size.
+  RefPtr<View> view = it->second.view;
+  if (!width || !height) {
+    width = (uint32_t)std::lround(view->width() / view->device_scale());
+    height = (uint32_t)std::lround(view->height() / view->device_scale());
+  }
+  ApplyScale(view.get(), width, height, scale);
+
+  // The load phase covers render(data) and what it loads. It parses nothing,
+  // so "dom ready" marks the end of the call.
+  BeginPhase("load", &RenderTimings::heap_peak_load);
+  Mark(&RenderTimings::load_begin);
+  {
+    RefPtr<JSContext> context = view->LockJSContext();
+    JSContextRef ctx = context->ctx();
+    JSObjectRef global = JSContextGetGlobalObject(ctx);
+
+    JSStringRef render_name = JSStringCreateWithUTF8CString("render");
+    JSValueRef render_fn = JSObjectGetProperty(ctx, global, render_name, nullptr);
+    JSStringRelease(render_name);
+    if (!JSValueIsObject(ctx, render_fn) ||
+        !JSObjectIsFunction(ctx, JSValueToObject(ctx, render_fn, nullptr)))
+      throw std::runtime_error("Template " + id + " does not define render(data)");
+
+    JSStringRef json_str = JSStringCreateWithUTF8CString(json.c_str());
+    JSValueRef data = JSValueMakeFromJSONString(ctx, json_str);
+    JSStringRelease(json_str);
+    if (!data)
+      throw std::runtime_error("Template data is not valid JSON");
+
+    if (!binaries.empty()) {
+      if (!JSValueIsObject(ctx, data))
+        data = JSObjectMake(ctx, nullptr, nullptr);
+      JSObjectRef data_obj = JSValueToObject(ctx, data, nullptr);
+
+      for (auto& binary : binaries) {
+        auto* bytes = new std::vector<uint8_t>(std::move(binary.bytes));
+        JSObjectRef array_buffer = JSObjectMakeArrayBufferWithBytesNoCopy(
+            ctx, bytes->data(), bytes->size(), DeleteTemplateBytes, bytes, nullptr);
+        if (!array_buffer) {
+          delete bytes;
+          continue;
+        }
+        JSStringRef name = JSStringCreateWithUTF8CString(binary.name.c_str());
+        JSObjectSetProperty(ctx, data_obj, name, array_buffer, kJSPropertyAttributeNone, nullptr);
+        JSStringRelease(name);
+      }
+    }
+
+    TraceScope trace("CallRender");
+    JSValueRef exception = nullptr;
+    JSObjectCallAsFunction(ctx, JSValueToObject(ctx, render_fn, nullptr), global, 1, &data,
+                           &exception);
+    if (exception)
+      throw std::runtime_error("render(data) threw: " + JSValueToStdString(ctx, exception));
+  }
+  Mark(&RenderTimings::dom_ready);
+
+  {
+    TraceScope trace("Update");
+    renderer_->Update();
+  }
+  // Loads started by render(data) get the same deadline as a page load. The
+  // template stays registered; its next render starts from whatever loaded.
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(load_timeout_ms_);
+  while (view->is_loading()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      view->Stop();
+      throw RenderTimeoutError("Timed out waiting for the template to load");
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    TraceScope trace("Update");
+    renderer_->Update();
+    if (timings_)
+      timings_->update_iterations++;
+  }
+  Mark(&RenderTimings::load_end);
+  return view;
+}
+
+RefPtr<Buffer> MyApp::RenderTemplate(const std::string& id, const std::string& json,
+                                     std::vector<TemplateBinary> binaries,
+                                     uint32_t width, uint32_t height,
+                                     const CaptureOptions& capture) {
+  RefPtr<View> view = ApplyTemplateData(id, json, std::move(binaries), width, height, capture.scale);
+  return CaptureRegion(view.get(), WholeSurface(view.get()), false, templates_[id].alpha);
+}
+
+// Paints, then encodes only what differs from the previous delta frame. The
+// surface's dirty bounds limit the comparison to what the engine repainted,
+// and the comparison against the kept frame drops repainted pixels that did
+// not change and splits distant changes into separate patches. Nothing
+// touches the dirty bounds between delta renders but this, so they cover
+// every paint since the last one.
+TemplateDelta MyApp::RenderTemplateDelta(const std::string& id, const std::string& json,
+                                         std::vector<TemplateBinary> binaries, uint32_t width,
+                                         uint32_t height, double scale, const DeltaOptions& delta) {
+  RefPtr<View> view = ApplyTemplateData(id, json, std::move(binaries), width, height, scale);
+  TemplateView& entry = templates_[id];
+  Paint(view.get());
+
+  Surface* surface = view->surface();
+  bool alpha = entry.alpha;
+
+  TemplateDelta result;
+  result.width = view->width();
+  result.height = view->height();
+  result.keyframe = delta.keyframe || entry.last_frame.empty() || entry.last_width != result.width ||
+                    entry.last_height != result.height || (delta.since && delta.since != entry.sequence) ||
+                    (delta.keyframe_interval && entry.deltas_since_keyframe >= delta.keyframe_interval);
+
+  IntRect dirty = surface->dirty_bounds().Intersect(IntRect{ 0, 0, (int)result.width, (int)result.height });
+  surface->ClearDirtyBounds();
+
+  BeginPhase("encode", &RenderTimings::heap_peak_encode);
+  Mark(&RenderTimings::encode_begin);
+  size_t frame_row_bytes = (size_t)result.width * 4;
+  SurfaceLock pixels(surface);
+  const uint8_t* src = pixels.data();
+  uint32_t src_row_bytes = pixels.row_bytes();
+
+  PixelRect changed;
+  if (result.keyframe) {
+    changed.width = result.width;
+    changed.height = result.height;
+    result.rects.push_back(changed);
+  } else if (dirty.IsValid()) {
+    changed.x = dirty.left;
+    changed.y = dirty.top;
+    changed.width = dirty.width();
+    changed.height = dirty.height();
+    TraceScope trace("Diff");
+    result.rects = FindChangedRects(src, src_row_bytes, entry.last_frame.data(),
+                                    (uint32_t)frame_row_bytes, changed);
+  }
+
+  std::vector<std::unique_ptr<std::vector<uint8_t>>> pngs(result.rects.size());
+  std::vector<std::function<void()>> tasks;
+  for (size_t i = 0; i < result.rects.size(); i++) {
+    PixelRect rect = result.rects[i];
+    pngs[i] = std::make_unique<std::vector<uint8_t>>();
+    std::vector<uint8_t>* png = pngs[i].get();
+    tasks.push_back([=] {
+      TraceScope trace("EncodePatch");
+      PngStreamEncoder encoder(rect.width, rect.height, alpha, Z_DEFAULT_COMPRESSION,
+                               [png](const uint8_t* data, size_t size) { png->insert(png->end(), data, data + size); });
+      encoder.WriteOffset((int32_t)rect.x, (int32_t)rect.y);
+      encoder.WriteBgraRows(src + (size_t)rect.y * src_row_bytes + (size_t)rect.x * 4, src_row_bytes,
+                            rect.height);
+      encoder.Finish();
+    });
+  }
+  if (!tasks.empty())
+    EncoderPool::instance().RunAll(std::move(tasks));
+
+  // Keep what the client now shows. Outside the repainted area the kept
+  // frame is already current.
+  if (result.keyframe) {
+    entry.last_frame.resize(frame_row_bytes * result.height);
+    changed.y = 0;
+    changed.height = result.height;
+  }
+  for (uint32_t y = changed.y; y < changed.y + changed.height; y++)
+    memcpy(entry.last_frame.data() + y * frame_row_bytes, src + (size_t)y * src_row_bytes, frame_row_bytes);
+  Mark(&RenderTimings::encode_end);
+
+  entry.last_width = result.width;
+  entry.last_height = result.height;
+  entry.deltas_since_keyframe = result.keyframe ? 0 : entry.deltas_since_keyframe + 1;
+  result.sequence = ++entry.sequence;
+  for (auto& png : pngs)
+    result.patches.push_back(std::move(png));
+  return result;
+}
+
+String MyApp::PreprocessHtml(const String& html) {
+  std::string htmlStr = html.utf8().data();
+
+  for (const auto& pair : imagePaths_) {
+    const std::string& imageName = pair.first;
+    const std::string& imagePath = pair.second;
+
+    std::string dataUrl = GetImageDataUrl(imagePath);
+    if (!dataUrl.empty()) {
+      std::string localRef = "url('local://" + imageName + "')";
+      std::string dataUrlRef = "url('" + dataUrl + "')";
+
+      size_t pos = 0;
+      while ((pos = htmlStr.find(localRef, pos)) != std::string::npos) {
+        htmlStr.replace(pos, localRef.length(), dataUrlRef);
+        pos += dataUrlRef.length();
+      }
+
+      localRef = "url(\"local://" + imageName + "\")";
+      while ((pos = htmlStr.find(localRef, pos)) != std::string::npos) {
+        htmlStr.replace(pos, localRef.length(), dataUrlRef);
+        pos += dataUrlRef.length();
+      }
+
+      localRef = "url(local://" + imageName + ")";
+      while ((pos = htmlStr.find(localRef, pos)) != std::string::npos) {
+        htmlStr.replace(pos, localRef.length(), dataUrlRef);
+        pos += dataUrlRef.length();
+      }
+    }
+  }
+
+  return String(htmlStr.c_str());
+}
+
+std::string MyApp::GetImageDataUrl(const std::string& imagePath) {
+  std::ifstream file(imagePath, std::ios::binary);
+  if (!file) {
+    LogMessage(LogLevel::Error, "Failed to open image file: " + String(imagePath.c_str()));
+    return "";
+  }
+
+  file.seekg(0, std::ios::end);
+  std::streamsize size = file.tellg();
+  file.seekg(0, std::ios::beg);
+
+  std::vector<uint8_t> buffer(size);
+  if (!file.read(reinterpret_cast<char*>(buffer.data()), size)) {
+    LogMessage(LogLevel::Error, "Failed to read image file: " + String(imagePath.c_str()));
+    return "";
+  }
+
+  std::string mimeType = "image/png";
+  std::string ext = imagePath.substr(imagePath.find_last_of(".") + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return std::tolower(c); });
+
+  if (ext == "jpg" || ext == "jpeg") {
+    mimeType = "image/jpeg";
+  } else if (ext == "gif") {
+    mimeType = "image/gif";
+  } else if (ext == "webp") {
+    mimeType = "image/webp";
+  } else if (ext == "svg") {
+    mimeType = "image/svg+xml";
+  }
+
+  std::string base64Data = Base64Encode(buffer.data(), buffer.size());
+  std::string dataUrl = "data:" + mimeType + ";base64," + base64Data;
+
+  return dataUrl;
+}
+
+std::string MyApp::Base64Encode(const uint8_t* data, size_t length) {
+  static const char* encoding = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve(((length + 2) / 3) * 4);
+
+  uint32_t value;
+  for (size_t i = 0; i < length; i += 3) {
+    value = data[i] << 16;
+    if (i + 1 < length) value |= data[i + 1] << 8;
+    if (i + 2 < length) value |= data[i + 2];
+
+    out.push_back(encoding[(value >> 18) & 0x3F]);
+    out.push_back(encoding[(value >> 12) & 0x3F]);
+    out.push_back((i + 1 < length) ? encoding[(value >> 6) & 0x3F] : '=');
+    out.push_back((i + 2 < length) ? encoding[value & 0x3F] : '=');
+  }
+
+  return out;
+}
+
+void MyApp::OnFinishLoading(ultralight::View* caller, uint64_t frame_id, bool is_main_frame,
+                            const String& url) {
+  TraceScope trace("OnFinishLoading");
+  if (is_main_frame && caller == view_.get()) {
+    LogMessage(LogLevel::Info, "Our page has loaded!");
+    done_ = true;
+  }
+}
+
+void MyApp::OnDOMReady(ultralight::View* caller,
+                       uint64_t frame_id,
+                       bool is_main_frame,
+                       const String& url) {
+  TraceScope trace("OnDOMReady");
+  if (is_main_frame && caller == view_.get()) {
+    Mark(&RenderTimings::dom_ready);
+    dom_ready_ = true;
+  }
+
+  if (is_main_frame && useLocalImages_) {
+    LogMessage(LogLevel::Info, "DOM is ready, processing any dynamic content...");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+}
+
+uint32_t MyApp::RemoteBudgetMs() const {
+  uint32_t budget = network_default_.remote_budget_ms;
+  if (network_policy_ && network_policy_->remote_budget_ms &&
+      (!budget || network_policy_->remote_budget_ms < budget))
+    budget = network_policy_->remote_budget_ms;
+  return budget;
+}
+
+bool MyApp::OnNetworkRequest(View* caller, NetworkRequest& request) {
+  if (!NetworkPolicy::IsRemote(request.urlProtocol().utf8().data()))
+    return true;
+
+  std::string host = request.urlHost().utf8().data();
+  const char* reason = nullptr;
+  if (!network_default_.AllowsHost(host) || (network_policy_ && !network_policy_->AllowsHost(host))) {
+    reason = "host not allowed";
+  } else if (loading_ && caller == view_.get() && RemoteBudgetMs() &&
+             std::chrono::steady_clock::now() - load_started_ >= std::chrono::milliseconds(RemoteBudgetMs())) {
+    reason = "remote fetch budget spent";
+  }
+
+  Metrics& metrics = Metrics::instance();
+  if (reason) {
+    metrics.network_blocked.fetch_add(1, std::memory_order_relaxed);
+    LogMessage(LogLevel::Info, "Blocked " + request.url() + " (" + String(reason) + ")");
+    return false;
+  }
+
+  if (loading_ && caller == view_.get())
+    remote_fetches_++;
+  metrics.network_allowed.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void MyApp::LogMessage(LogLevel log_level, const String& message) {
+  if (capturing_memory_log_) {
+    memory_log_ += message.utf8().data();
+    memory_log_ += '\n';
+    return;
+  }
+
+  AsyncLogger& logger = AsyncLogger::instance();
+  if (!logger.enabled(log_level))
+    return;
+
+  String8 text = message.utf8();
+  logger.Log(log_level, text.data(), text.length());
+}
@@ -0,0 +1,322 @@
+#pragma once
+#include "memory_governor.h"
+#include "network_policy.h"
+#include "pixel_rect.h"
+#include "png_stream.h"
+#include "timings.h"
+#include <Ultralight/Ultralight.h>
+#include <AppCore/AppCore.h>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// View settings selectable per request. Views are pooled per profile, since
+// a ViewConfig is fixed once the View is created. Empty strings keep the
+// engine defaults.
+struct ViewProfile {
+  bool enable_javascript = true;
+  bool enable_images = true;
+  bool is_transparent = false;
+  std::string font_family_standard;
+  std::string font_family_fixed;
+  std::string font_family_serif;
+  std::string font_family_sans_serif;
+  std::string user_agent;
+
+  std::string Key() const;
+};
+
+// One resampled output, in device pixels. A height of 0 keeps the aspect
+// ratio of the capture.
+struct OutputSize {
+  uint32_t width = 0;
+  uint32_t height = 0;
+};
+
+// One layout viewport, in CSS pixels. A height of 0 uses the request height.
+struct Viewport {
+  uint32_t width = 0;
+  uint32_t height = 0;
+};
+
+// Smallest band for tiled capture. Each band costs a scroll and a repaint,
+// so the bindings raise smaller tile heights to this.
+constexpr uint32_t kMinTileHeight = 256;
+
+// Output settings for a single capture.
+struct CaptureOptions {
+  // Device pixels per CSS pixel. The view is laid out at width x height CSS
+  // pixels and its surface is width * scale x height * scale.
+  double scale = 1.0;
+  // Grow the view to the document's scroll height after load. `height` is
+  // then the layout viewport and the minimum output height.
+  bool full_page = false;
+  // Render in bands of this many CSS pixels through one band-sized surface
+  // and stream the rows into the PNG encoder. 0 uses a single surface.
+  // Capped at the full-page height limit.
+  uint32_t tile_height = 0;
+  // Encode one PNG per entry, resampled from the single captured surface,
+  // instead of one PNG at the surface size.
+  std::vector<OutputSize> sizes;
+  // Encode only the bounding box of the first element matching this CSS
+  // selector. The view grows first if the element extends past it.
+  std::string selector;
+  // Crop uniform borders, the color of the top-left pixel, off the captured
+  // area before encoding.
+  bool trim = false;
+  // Load once, then lay out, paint and encode the page once per viewport.
+  std::vector<Viewport> viewports;
+  // Capture an animated PNG of this many milliseconds instead. CSS animations
+  // and transitions are paused and stepped through virtual time, one frame
+  // every 1000 / animation_fps milliseconds.
+  uint32_t animation_duration_ms = 0;
+  uint32_t animation_fps = 10;
+};
+
+// Returns why the capture modes in `capture` do not compose, or nullptr if
+// they do. `streaming` is true when the PNG goes to a stream sink. Cheap, so
+// callers check before a render is queued.
+const char* CaptureOptionsError(const CaptureOptions& capture, bool streaming);
+
+struct WarmupOptions {
+  std::vector<std::string> html;
+  std::vector<std::string> fonts;
+  uint32_t views = 1;
+  uint32_t load_timeout_ms = 30000;
+  // Largest surface, in device pixels, a single render may allocate.
+  uint64_t max_pixels = 8192ull * 8192ull;
+  // Upper bound, in CSS pixels, for full-page captures.
+  uint32_t max_full_page_height = 16384;
+  // Surface memory kept mapped for reuse after views shrink or go away.
+  uint64_t surface_pool_bytes = 256ull << 20;
+};
+
+// Settings for RenderTemplateDelta.
+struct DeltaOptions {
+  // Send a full frame after this many patch frames. 0 only sends keyframes
+  // when they are needed.
+  uint32_t keyframe_interval = 30;
+  // Send a full frame now.
+  bool keyframe = false;
+  // The last sequence number the client applied. A mismatch means it missed
+  // a frame and gets a keyframe. 0 skips the check.
+  uint64_t since = 0;
+};
+
+// One frame of a delta render. A keyframe has a single patch covering the
+// whole surface; otherwise the patches hold only what changed since the
+// previous frame, and there may be none. Each patch PNG carries its position
+// in an oFFs chunk. The patches own their bytes, so the frame can leave the
+// RenderThread.
+struct TemplateDelta {
+  bool keyframe = false;
+  uint64_t sequence = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<PixelRect> rects;
+  std::vector<PngData> patches;
+};
+
+class RenderTimeoutError : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+struct PlatformOptions {
+  ultralight::FileSystem* file_system = nullptr;
+  ultralight::FontLoader* font_loader = nullptr;
+  MemoryBudget memory;
+  // Process-wide network policy. Per-request policies can only narrow it.
+  NetworkPolicy network;
+  // Config::cache_path. The engine keeps its HTTP cache for remote fetches
+  // here, so allowed assets survive purges and restarts. Empty keeps it in
+  // memory only.
+  std::string http_cache_path;
+};
+
+struct TemplateBinary {
+  std::string name;
+  std::vector<uint8_t> bytes;
+};
+
+class MyApp : public ultralight::LoadListener,
+              public ultralight::ViewListener,
+              public ultralight::NetworkListener,
+              public ultralight::Logger {
+private:
+  ultralight::RefPtr<ultralight::Renderer> renderer_;
+  ultralight::RefPtr<ultralight::View> view_;
+  struct PooledView {
+    ultralight::RefPtr<ultralight::View> view;
+    uint32_t renders = 0;
+  };
+  struct ViewPool {
+    std::vector<PooledView> idle;
+    uint64_t last_used = 0;
+  };
+
+  std::map<std::string, ViewPool> pools_;
+  uint64_t pool_clock_ = 0;
+  // A template's view stays loaded between renders. The last frame sent as a
+  // delta is kept so the next one can be diffed against it.
+  struct TemplateView {
+    ultralight::RefPtr<ultralight::View> view;
+    bool alpha = false;
+    std::vector<uint8_t> last_frame;
+    uint32_t last_width = 0;
+    uint32_t last_height = 0;
+    uint32_t deltas_since_keyframe = 0;
+    uint64_t sequence = 0;
+  };
+
+  std::map<std::string, TemplateView> templates_;
+  bool done_ = false;
+  std::map<std::string, std::string> imagePaths_;
+  bool useLocalImages_ = false;
+  RenderTimings* timings_ = nullptr;
+  const PngStreamEncoder::Sink* stream_sink_ = nullptr;
+  std::vector<ultralight::RefPtr<ultralight::Buffer>>* outputs_ = nullptr;
+  NetworkPolicy network_default_;
+  const NetworkPolicy* network_policy_ = nullptr;
+  // Set while LoadAndWait() runs, for the remote fetch budget.
+  bool loading_ = false;
+  bool dom_ready_ = false;
+  uint32_t remote_fetches_ = 0;
+  std::chrono::steady_clock::time_point load_started_;
+  uint32_t load_timeout_ms_ = 30000;
+  uint64_t max_pixels_ = 8192ull * 8192ull;
+  uint32_t max_full_page_height_ = 16384;
+  uint32_t busy_views_ = 0;
+  // Render counts of views that are out of their pool.
+  std::map<ultralight::View*, uint32_t> busy_renders_;
+  uint32_t warm_views_ = 1;
+  MemoryGovernor governor_;
+  bool purged_since_job_ = true;
+  bool capturing_memory_log_ = false;
+  std::string memory_log_;
+  std::chrono::steady_clock::time_point last_memory_sample_;
+
+  MyApp();
+
+  friend class RenderThread;
+
+  void Mark(RenderTimings::Clock::time_point RenderTimings::*phase) {
+    if (timings_)
+      timings_->*phase = RenderTimings::Clock::now();
+  }
+  void BeginPhase(const char* name, uint64_t RenderTimings::*heap_peak);
+
+  ultralight::RefPtr<ultralight::View> AcquireView(uint32_t width, uint32_t height,
+                                                   const ViewProfile& profile, double scale);
+  void ApplyScale(ultralight::View* view, uint32_t width, uint32_t height, double scale);
+  long MeasureContentHeight(ultralight::View* view);
+  void FitToContent(ultralight::View* view, uint32_t width, uint32_t height, double scale);
+  bool MeasureElement(ultralight::View* view, const std::string& selector, double box[4]);
+  PixelRect FitToElement(ultralight::View* view, const std::string& selector, double scale);
+  void CaptureTiled(ultralight::View* view, uint32_t height, bool alpha,
+                    const CaptureOptions& capture, const PngStreamEncoder::Sink& sink);
+  void ReleaseView(ultralight::RefPtr<ultralight::View> view, const ViewProfile& profile);
+  void UpdateViewGauges();
+  uint32_t RemoteBudgetMs() const;
+  void PurgeMemory();
+
+  ultralight::RefPtr<ultralight::View> CreateView(uint32_t width, uint32_t height,
+                                                  const ViewProfile& profile = ViewProfile(),
+                                                  double scale = 1.0);
+  void LoadAndWait(ultralight::RefPtr<ultralight::View> view, const ultralight::String& html_string);
+  void Paint(ultralight::View* view);
+  void SeekAnimations(ultralight::View* view, double time_ms);
+  ultralight::RefPtr<ultralight::Buffer> CaptureAnimation(ultralight::View* view, bool alpha,
+                                                          const CaptureOptions& capture);
+  void CaptureViewports(ultralight::View* view, uint32_t height, bool alpha,
+                        const CaptureOptions& capture);
+  PixelRect TrimToContent(ultralight::View* view, PixelRect rect);
+  ultralight::RefPtr<ultralight::Buffer> CaptureRegion(ultralight::View* view, PixelRect rect, bool trim,
+                                                       bool alpha);
+  void CaptureSizes(ultralight::View* view, PixelRect rect, bool trim, bool alpha,
+                    const std::vector<OutputSize>& sizes);
+  ultralight::RefPtr<ultralight::View> ApplyTemplateData(const std::string& id, const std::string& json,
+                                                         std::vector<TemplateBinary> binaries,
+                                                         uint32_t width, uint32_t height, double scale);
+  ultralight::RefPtr<ultralight::Buffer> LoadAndCapture(const ultralight::String& html_string,
+                                                        uint32_t width, uint32_t height,
+                                                        const ViewProfile& profile,
+                                                        const CaptureOptions& capture);
+
+public:
+  ~MyApp();
+
+  static void set_platform_options(const PlatformOptions& options);
+
+  // Phase timestamps of the current job are written here until reset to null.
+  void set_timings(RenderTimings* timings);
+
+  // While set, Run() and RunWithImages() hand the encoded PNG to the sink as
+  // it is produced and return null.
+  void set_stream_sink(const PngStreamEncoder::Sink* sink) { stream_sink_ = sink; }
+
+  // Receives one PNG per CaptureOptions::sizes or viewports entry, in order.
+  // Run() and RunWithImages() return null for such captures.
+  void set_outputs(std::vector<ultralight::RefPtr<ultralight::Buffer>>* outputs) {
+    outputs_ = outputs;
+  }
+
+  // Remote fetches must pass both this and the process-wide policy.
+  void set_network_policy(const NetworkPolicy* policy) { network_policy_ = policy; }
+
+  void Warmup(const WarmupOptions& options);
+
+  // Called by the RenderThread after every job and when its queue is empty.
+  void AfterJob();
+  void OnIdle();
+
+  // Updates the engine memory gauge from Renderer::LogMemoryUsage(). OnIdle()
+  // does this every 10 s; a queue that never drains has to ask.
+  void SampleEngineMemory();
+
+  ultralight::RefPtr<ultralight::Buffer> Run(const ultralight::String& html_string,
+                                             uint32_t width = 1600, uint32_t height = 800,
+                                             const ViewProfile& profile = ViewProfile(),
+                                             const CaptureOptions& capture = CaptureOptions());
+
+  ultralight::RefPtr<ultralight::Buffer> RunWithImages(const ultralight::String& html_string,
+                                                       const std::map<std::string, std::string>& imagePaths,
+                                                       uint32_t width = 1600,
+                                                       uint32_t height = 800,
+                                                       const ViewProfile& profile = ViewProfile(),
+                                                       const CaptureOptions& capture = CaptureOptions());
+
+  // Templates always run with JavaScript, since render(data) is a script.
+  void RegisterTemplate(const std::string& id, const ultralight::String& html_string,
+                        uint32_t width = 1600, uint32_t height = 800,
+                        const ViewProfile& profile = ViewProfile());
+  bool UnregisterTemplate(const std::string& id);
+  ultralight::RefPtr<ultralight::Buffer> RenderTemplate(const std::string& id,
+                                                        const std::string& json,
+                                                        std::vector<TemplateBinary> binaries,
+                                                        uint32_t width = 0, uint32_t height = 0,
+                                                        const CaptureOptions& capture = CaptureOptions());
+  // Renders the data like RenderTemplate, but returns only the rectangles
+  // that changed since the previous delta render of the template.
+  TemplateDelta RenderTemplateDelta(const std::string& id, const std::string& json,
+                                    std::vector<TemplateBinary> binaries, uint32_t width = 0,
+                                    uint32_t height = 0, double scale = 1.0,
+                                    const DeltaOptions& delta = DeltaOptions());
+
+  ultralight::String PreprocessHtml(const ultralight::String& html);
+  std::string GetImageDataUrl(const std::string& imagePath);
+  std::string Base64Encode(const uint8_t* data, size_t length);
+
+  virtual void OnFinishLoading(ultralight::View* caller, uint64_t frame_id, bool is_main_frame,
+                               const ultralight::String& url) override;
+
+  virtual void OnDOMReady(ultralight::View* caller,
+                         uint64_t frame_id,
+                         bool is_main_frame,
+                         const ultralight::String& url) override;
+
+  virtual void LogMessage(ultralight::LogLevel log_level, const ultralight::String& message) override;
+
+  virtual bool OnNetworkRequest(ultralight::View* caller, ultralight::NetworkRequest& request) override;
+};
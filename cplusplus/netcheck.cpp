@@ -0,0 +1,288 @@
+// Network policy check. Serves stub assets over HTTP on 127.0.0.1 and renders
+// pages that fetch them through ProcessRenderRequest, counting the requests
+// that reach the server:
+//
+//   block      "block" keeps every fetch from the server.
+//   allowlist  an allowlisted host is fetched, another host is blocked.
+//   budget     a fetch the server holds open is stopped once the remote
+//              budget is spent, and the render finishes without it.
+//   cache      a second render of an asset sent with Cache-Control is served
+//              from the engine's HTTP cache.
+//
+//   netcheck [--slow-ms N] [--budget-ms N] [--cache-dir DIR]
+//
+// Run from the directory that contains assets/, like the addon. Prints one
+// line per check and exits 1 if any fails.
+
+#include "async_logger.h"
+#include "metrics.h"
+#include "png_stream.h"
+#include "render_service.h"
+#include "render_thread.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+struct NetcheckOptions {
+  uint32_t slow_ms = 10000;
+  uint32_t budget_ms = 500;
+  std::string cache_dir;
+};
+
+// Answers GET requests for any path with a 1x1 PNG and counts them by path.
+// Paths starting with /slow are held for slow_ms first, and paths starting
+// with /cached are sent with Cache-Control: max-age.
+class StubServer {
+public:
+  explicit StubServer(uint32_t slow_ms) : slow_ms_(slow_ms) {
+    uint8_t pixel[4] = { 0x40, 0x80, 0xC0, 0xFF };
+    PngStreamEncoder encoder(1, 1, false, 6, [this](const uint8_t* data, size_t size) {
+      png_.insert(png_.end(), data, data + size);
+    });
+    encoder.WriteBgraRows(pixel, sizeof(pixel), 1);
+    encoder.Finish();
+  }
+
+  ~StubServer() {
+    stopping_ = true;
+    if (listen_fd_ >= 0) {
+      shutdown(listen_fd_, SHUT_RDWR);
+      close(listen_fd_);
+    }
+    if (acceptor_.joinable())
+      acceptor_.join();
+    for (auto& handler : handlers_)
+      handler.join();
+  }
+
+  bool Start() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if (listen_fd_ < 0 || bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd_, 16) < 0 || getsockname(listen_fd_, (sockaddr*)&addr, &length) < 0) {
+      perror("stub server");
+      return false;
+    }
+    port_ = ntohs(addr.sin_port);
+    acceptor_ = std::thread([this] { Accept(); });
+    return true;
+  }
+
+  uint16_t port() const { return port_; }
+
+  uint32_t hits(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_[path];
+  }
+
+private:
+  void Accept() {
+    while (!stopping_) {
+      int fd = accept(listen_fd_, nullptr, nullptr);
+      if (fd < 0)
+        continue;
+      std::lock_guard<std::mutex> lock(mutex_);
+      handlers_.emplace_back([this, fd] { Serve(fd); });
+    }
+  }
+
+  void Serve(int fd) {
+    std::string request;
+    char buffer[2048];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 16384) {
+      ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+      if (n <= 0)
+        break;
+      request.append(buffer, n);
+    }
+
+    size_t start = request.find(' ');
+    size_t end = start == std::string::npos ? start : request.find_first_of(" ?", start + 1);
+    std::string path = end == std::string::npos ? "" : request.substr(start + 1, end - start - 1);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      hits_[path]++;
+    }
+
+    if (path.compare(0, 5, "/slow") == 0) {
+      auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(slow_ms_);
+      while (!stopping_ && std::chrono::steady_clock::now() < until)
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    std::string headers = "HTTP/1.1 200 OK\r\nContent-Type: image/png\r\nContent-Length: " +
+                          std::to_string(png_.size()) + "\r\nCache-Control: " +
+                          (path.compare(0, 7, "/cached") == 0 ? "max-age=3600" : "no-store") +
+                          "\r\nConnection: close\r\n\r\n";
+    send(fd, headers.data(), headers.size(), MSG_NOSIGNAL);
+    send(fd, png_.data(), png_.size(), MSG_NOSIGNAL);
+    close(fd);
+  }
+
+  uint32_t slow_ms_;
+  std::vector<uint8_t> png_;
+  int listen_fd_ = -1;
+  uint16_t port_ = 0;
+  std::atomic<bool> stopping_{false};
+  std::thread acceptor_;
+  std::vector<std::thread> handlers_;
+  std::mutex mutex_;
+  std::map<std::string, uint32_t> hits_;
+};
+
+struct RenderOutcome {
+  bool ok = false;
+  double ms = 0;
+  std::string error;
+};
+
+// Renders <img> tags for the given URLs, bypassing the result cache.
+static RenderOutcome RenderImages(const std::vector<std::string>& urls, const NetworkPolicy& network) {
+  RenderRequest request;
+  request.width = 200;
+  request.height = 100;
+  request.use_cache = false;
+  request.network = network;
+  request.html = "<html><body>";
+  for (const std::string& url : urls)
+    request.html += "<img src=\"" + url + "\" width=\"20\" height=\"20\">";
+  request.html += "</body></html>";
+
+  RenderOutcome outcome;
+  auto started = std::chrono::steady_clock::now();
+  try {
+    outcome.ok = ProcessRenderRequest(request).png != nullptr;
+  } catch (const std::exception& e) {
+    outcome.error = e.what();
+  }
+  outcome.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+  return outcome;
+}
+
+static bool Report(const char* name, bool passed, const std::string& detail) {
+  std::cout << (passed ? "> PASS " : "> FAIL ") << name << ": " << detail << std::endl;
+  return passed;
+}
+
+static std::string Describe(const RenderOutcome& outcome) {
+  char line[64];
+  snprintf(line, sizeof(line), "%.0f ms", outcome.ms);
+  return outcome.ok ? std::string(line) : "render failed (" + outcome.error + ")";
+}
+
+static bool ParseArgs(int argc, char** argv, NetcheckOptions* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "> Missing value for " << arg << std::endl;
+      return false;
+    }
+    const char* value = argv[++i];
+    if (arg == "--slow-ms")
+      options->slow_ms = strtoul(value, nullptr, 10);
+    else if (arg == "--budget-ms")
+      options->budget_ms = strtoul(value, nullptr, 10);
+    else if (arg == "--cache-dir")
+      options->cache_dir = value;
+    else {
+      std::cerr << "> Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if (!options->budget_ms || options->budget_ms * 2 >= options->slow_ms) {
+    std::cerr << "> --budget-ms must be positive and under half of --slow-ms" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  NetcheckOptions options;
+  if (!ParseArgs(argc, argv, &options))
+    return 2;
+
+  if (options.cache_dir.empty()) {
+    char dir[] = "/tmp/netcheck-cache-XXXXXX";
+    if (!mkdtemp(dir)) {
+      perror("mkdtemp");
+      return 1;
+    }
+    options.cache_dir = dir;
+  }
+
+  StubServer server(options.slow_ms);
+  if (!server.Start())
+    return 1;
+  std::string origin = "http://127.0.0.1:" + std::to_string(server.port());
+  std::string other_origin = "http://localhost:" + std::to_string(server.port());
+
+  AsyncLogger::instance().set_level((int)ultralight::LogLevel::Error);
+
+  PlatformOptions platform_options;
+  platform_options.memory = MemoryBudget::FromEnvironment();
+  platform_options.http_cache_path = options.cache_dir;
+  MyApp::set_platform_options(platform_options);
+  RenderThread::instance().Post([](MyApp& app) { app.Warmup(WarmupOptions()); }).get();
+
+  Metrics& metrics = Metrics::instance();
+  bool passed = true;
+
+  {
+    NetworkPolicy block;
+    block.mode = NetworkPolicy::Mode::Block;
+    uint64_t blocked = metrics.network_blocked.load();
+    RenderOutcome outcome = RenderImages({ origin + "/blocked.png" }, block);
+    passed &= Report("block", outcome.ok && server.hits("/blocked.png") == 0 &&
+                                  metrics.network_blocked.load() > blocked,
+                     Describe(outcome) + ", server hits " + std::to_string(server.hits("/blocked.png")));
+  }
+
+  {
+    NetworkPolicy allowlist;
+    allowlist.mode = NetworkPolicy::Mode::AllowList;
+    allowlist.hosts.push_back("127.0.0.1");
+    uint64_t blocked = metrics.network_blocked.load();
+    RenderOutcome outcome = RenderImages({ origin + "/allowed.png", other_origin + "/other.png" }, allowlist);
+    passed &= Report("allowlist", outcome.ok && server.hits("/allowed.png") == 1 &&
+                                      server.hits("/other.png") == 0 && metrics.network_blocked.load() > blocked,
+                     Describe(outcome) + ", allowed hits " + std::to_string(server.hits("/allowed.png")) +
+                         ", other hits " + std::to_string(server.hits("/other.png")));
+  }
+
+  {
+    NetworkPolicy budget;
+    budget.remote_budget_ms = options.budget_ms;
+    uint64_t stops = metrics.network_budget_stops.load();
+    RenderOutcome outcome = RenderImages({ origin + "/slow.png" }, budget);
+    passed &= Report("budget", outcome.ok && server.hits("/slow.png") == 1 && outcome.ms < options.slow_ms / 2.0 &&
+                                   metrics.network_budget_stops.load() == stops + 1,
+                     Describe(outcome) + " against a " + std::to_string(options.slow_ms) + " ms fetch, stops " +
+                         std::to_string(metrics.network_budget_stops.load() - stops));
+  }
+
+  {
+    NetworkPolicy allow;
+    RenderOutcome first = RenderImages({ origin + "/cached.png" }, allow);
+    RenderOutcome second = RenderImages({ origin + "/cached.png" }, allow);
+    passed &= Report("cache", first.ok && second.ok && server.hits("/cached.png") == 1,
+                     Describe(second) + ", server hits " + std::to_string(server.hits("/cached.png")) +
+                         " for two renders, cache in " + options.cache_dir);
+  }
+
+  return passed ? 0 : 1;
+}
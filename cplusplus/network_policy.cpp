@@ -0,0 +1,86 @@
+#include "network_policy.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+
+static std::string ToLower(std::string value) {
+  std::transform(value.begin(), value.end(), value.begin(),
+                 [](unsigned char c) { return (char)std::tolower(c); });
+  return value;
+}
+
+bool NetworkPolicy::AllowsHost(const std::string& host) const {
+  if (mode != Mode::AllowList)
+    return mode == Mode::Allow;
+
+  std::string name = ToLower(host);
+  for (const std::string& host_entry : hosts) {
+    std::string entry = ToLower(host_entry);
+    if (entry == name)
+      return true;
+    // "*.example.com" keeps the dot, so "badexample.com" does not match.
+    if (entry.size() > 2 && entry.compare(0, 2, "*.") == 0 && name.size() > entry.size() - 1 &&
+        name.compare(name.size() - (entry.size() - 1), entry.size() - 1, entry, 1) == 0)
+      return true;
+  }
+  return false;
+}
+
+std::string NetworkPolicy::Key() const {
+  std::string key;
+  key += mode == Mode::Allow ? 'a' : mode == Mode::Block ? 'b' : 'l';
+  key += std::to_string(remote_budget_ms);
+  for (const std::string& host : hosts) {
+    key += '\x1f';
+    key += host;
+  }
+  return key;
+}
+
+bool NetworkPolicy::IsRemote(const std::string& protocol) {
+  std::string name = ToLower(protocol);
+  return name != "file" && name != "data" && name != "blob" && name != "about";
+}
+
+bool NetworkPolicy::ParseMode(const std::string& name, Mode* mode) {
+  if (name == "allow")
+    *mode = Mode::Allow;
+  else if (name == "block")
+    *mode = Mode::Block;
+  else if (name == "allowlist")
+    *mode = Mode::AllowList;
+  else
+    return false;
+  return true;
+}
+
+void NetworkPolicy::ParseHosts(const std::string& list, std::vector<std::string>* hosts) {
+  std::stringstream stream(list);
+  std::string host;
+  while (std::getline(stream, host, ',')) {
+    host.erase(0, host.find_first_not_of(" \t"));
+    host.erase(host.find_last_not_of(" \t") + 1);
+    if (!host.empty())
+      hosts->push_back(host);
+  }
+}
+
+NetworkPolicy NetworkPolicy::FromEnvironment() {
+  NetworkPolicy policy;
+
+  const char* hosts = getenv("RENDER_NETWORK_HOSTS");
+  if (hosts && *hosts) {
+    ParseHosts(hosts, &policy.hosts);
+    policy.mode = Mode::AllowList;
+  }
+
+  const char* mode = getenv("RENDER_NETWORK");
+  if (mode && *mode)
+    ParseMode(ToLower(mode), &policy.mode);
+
+  const char* budget = getenv("RENDER_NETWORK_BUDGET_MS");
+  if (budget && *budget)
+    policy.remote_budget_ms = (uint32_t)strtoul(budget, nullptr, 10);
+  return policy;
+}
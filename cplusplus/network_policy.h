@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Which remote fetches (http, https, ws, ...) a page may make while it
+// renders. file:, data: and blob: URLs, which cover ./assets and uploaded
+// images, are always allowed.
+struct NetworkPolicy {
+  enum class Mode { Allow, Block, AllowList };
+
+  Mode mode = Mode::Allow;
+  // Hosts for Mode::AllowList, compared case-insensitively. "*.example.com"
+  // matches every subdomain of example.com.
+  std::vector<std::string> hosts;
+  // Remote fetches may only start within this many milliseconds of the load.
+  // Once it is spent, fetches still pending are stopped and the page is
+  // captured as far as it got. 0 is no budget.
+  uint32_t remote_budget_ms = 0;
+
+  bool AllowsHost(const std::string& host) const;
+  std::string Key() const;
+
+  static bool IsRemote(const std::string& protocol);
+  // "allow", "block" or "allowlist".
+  static bool ParseMode(const std::string& name, Mode* mode);
+  // Appends the hosts of a comma separated list, trimmed.
+  static void ParseHosts(const std::string& list, std::vector<std::string>* hosts);
+  // RENDER_NETWORK, RENDER_NETWORK_HOSTS (comma separated, implies
+  // allowlist) and RENDER_NETWORK_BUDGET_MS.
+  static NetworkPolicy FromEnvironment();
+};
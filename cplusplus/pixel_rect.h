@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+
+// Area of the surface to encode, in device pixels.
+struct PixelRect {
+  uint32_t x = 0;
+  uint32_t y = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+};
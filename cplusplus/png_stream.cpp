@@ -0,0 +1,153 @@
+#include "png_stream.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static void PutU32(uint8_t* out, uint32_t value) {
+  out[0] = (uint8_t)(value >> 24);
+  out[1] = (uint8_t)(value >> 16);
+  out[2] = (uint8_t)(value >> 8);
+  out[3] = (uint8_t)value;
+}
+
+PngRowFilter::PngRowFilter(uint32_t width, bool alpha) : width_(width), alpha_(alpha) {
+  size_t channels = alpha ? 4 : 3;
+  row_.resize(width * channels);
+  previous_row_.assign(width * channels, 0);
+  filtered_.resize(width * channels + 1);
+}
+
+void PngRowFilter::Reset() {
+  std::fill(previous_row_.begin(), previous_row_.end(), 0);
+}
+
+const std::vector<uint8_t>& PngRowFilter::Filter(const uint8_t* bgra) {
+  const uint8_t* src = bgra;
+  uint8_t* dst = row_.data();
+  for (uint32_t x = 0; x < width_; x++, src += 4) {
+    uint8_t b = src[0], g = src[1], r = src[2], a = src[3];
+    if (alpha_ && a != 0 && a != 255) {
+      r = (uint8_t)std::min(255, (r * 255 + a / 2) / a);
+      g = (uint8_t)std::min(255, (g * 255 + a / 2) / a);
+      b = (uint8_t)std::min(255, (b * 255 + a / 2) / a);
+    }
+    *dst++ = r;
+    *dst++ = g;
+    *dst++ = b;
+    if (alpha_)
+      *dst++ = a;
+  }
+
+  // The Up filter suits screenshots, where consecutive rows are often
+  // identical, and only needs the previous row.
+  filtered_[0] = 2;
+  for (size_t i = 0; i < row_.size(); i++)
+    filtered_[i + 1] = (uint8_t)(row_[i] - previous_row_[i]);
+  row_.swap(previous_row_);
+  return filtered_;
+}
+
+void WritePngChunk(const std::function<void(const uint8_t*, size_t)>& sink, const char* type,
+                   const uint8_t* data, size_t size) {
+  uint8_t header[8];
+  PutU32(header, (uint32_t)size);
+  memcpy(header + 4, type, 4);
+
+  uLong crc = crc32(0, header + 4, 4);
+  if (size)
+    crc = crc32(crc, data, (uInt)size);
+  uint8_t trailer[4];
+  PutU32(trailer, (uint32_t)crc);
+
+  sink(header, sizeof(header));
+  if (size)
+    sink(data, size);
+  sink(trailer, sizeof(trailer));
+}
+
+void WritePngHeader(const std::function<void(const uint8_t*, size_t)>& sink, uint32_t width,
+                    uint32_t height, bool alpha) {
+  static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+  sink(kSignature, sizeof(kSignature));
+
+  uint8_t header[13];
+  PutU32(header, width);
+  PutU32(header + 4, height);
+  header[8] = 8;                 // bit depth
+  header[9] = alpha ? 6 : 2;     // RGBA or RGB
+  header[10] = 0;                // deflate
+  header[11] = 0;                // adaptive filtering
+  header[12] = 0;                // no interlace
+  WritePngChunk(sink, "IHDR", header, sizeof(header));
+}
+
+PngStreamEncoder::PngStreamEncoder(uint32_t width, uint32_t height, bool alpha, int level,
+                                   Sink sink)
+    : height_(height), sink_(std::move(sink)), filter_(width, alpha) {
+  memset(&stream_, 0, sizeof(stream_));
+  if (deflateInit(&stream_, level) != Z_OK)
+    throw std::runtime_error("deflateInit failed");
+
+  out_.resize(kChunkSize);
+  stream_.next_out = out_.data();
+  stream_.avail_out = (uInt)out_.size();
+
+  WritePngHeader(sink_, width, height, alpha);
+}
+
+PngStreamEncoder::~PngStreamEncoder() {
+  deflateEnd(&stream_);
+}
+
+void PngStreamEncoder::WriteOffset(int32_t x, int32_t y) {
+  if (rows_written_)
+    throw std::runtime_error("PNG offset must precede the image data");
+
+  uint8_t offset[9];
+  PutU32(offset, (uint32_t)x);
+  PutU32(offset + 4, (uint32_t)y);
+  offset[8] = 0;                 // pixels
+  WritePngChunk(sink_, "oFFs", offset, sizeof(offset));
+}
+
+void PngStreamEncoder::Deflate(const uint8_t* data, size_t size, int flush) {
+  stream_.next_in = const_cast<Bytef*>(data);
+  stream_.avail_in = (uInt)size;
+
+  for (;;) {
+    int result = deflate(&stream_, flush);
+    if (result == Z_STREAM_ERROR)
+      throw std::runtime_error("deflate failed");
+
+    if (stream_.avail_out == 0) {
+      WritePngChunk(sink_, "IDAT", out_.data(), out_.size());
+      stream_.next_out = out_.data();
+      stream_.avail_out = (uInt)out_.size();
+      continue;
+    }
+    if (flush == Z_FINISH ? result == Z_STREAM_END : stream_.avail_in == 0)
+      break;
+  }
+}
+
+void PngStreamEncoder::WriteBgraRows(const uint8_t* pixels, uint32_t row_bytes, uint32_t rows) {
+  if (rows_written_ + rows > height_)
+    throw std::runtime_error("Too many rows written to PNG stream");
+
+  for (uint32_t y = 0; y < rows; y++) {
+    const std::vector<uint8_t>& scanline = filter_.Filter(pixels + (size_t)y * row_bytes);
+    Deflate(scanline.data(), scanline.size(), Z_NO_FLUSH);
+    rows_written_++;
+  }
+}
+
+void PngStreamEncoder::Finish() {
+  if (rows_written_ != height_)
+    throw std::runtime_error("PNG stream finished before all rows were written");
+
+  Deflate(nullptr, 0, Z_FINISH);
+  size_t pending = out_.size() - stream_.avail_out;
+  if (pending)
+    WritePngChunk(sink_, "IDAT", out_.data(), pending);
+  WritePngChunk(sink_, "IEND", nullptr, 0);
+}
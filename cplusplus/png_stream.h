@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <zlib.h>
+
+// An encoded PNG. Immutable, so it can be shared between threads.
+using PngData = std::shared_ptr<const std::vector<uint8_t>>;
+
+// Turns premultiplied BGRA rows, as produced by Ultralight, into filtered PNG
+// scanlines: straight-alpha RGB(A) with the Up filter, prefixed by the filter
+// type byte.
+class PngRowFilter {
+public:
+  PngRowFilter(uint32_t width, bool alpha);
+
+  // Returns the scanline for `bgra`. Valid until the next call.
+  const std::vector<uint8_t>& Filter(const uint8_t* bgra);
+
+  // Starts a new image, whose first row has no previous row.
+  void Reset();
+
+private:
+  uint32_t width_;
+  bool alpha_;
+  std::vector<uint8_t> row_;
+  std::vector<uint8_t> previous_row_;
+  std::vector<uint8_t> filtered_;
+};
+
+// Writes one length-prefixed, CRC-terminated PNG chunk to `sink`.
+void WritePngChunk(const std::function<void(const uint8_t*, size_t)>& sink, const char* type,
+                   const uint8_t* data, size_t size);
+
+// Writes the PNG signature and an 8-bit RGBA or RGB IHDR chunk to `sink`.
+void WritePngHeader(const std::function<void(const uint8_t*, size_t)>& sink, uint32_t width,
+                    uint32_t height, bool alpha);
+
+// Incremental PNG encoder. Rows are converted, filtered and deflated as they
+// arrive and each full IDAT chunk is handed to the sink, so memory is bounded
+// by one row plus one chunk regardless of the image height.
+class PngStreamEncoder {
+public:
+  typedef std::function<void(const uint8_t* data, size_t size)> Sink;
+
+  static const size_t kChunkSize = 64 * 1024;
+
+  // Writes the signature and IHDR immediately. `alpha` selects RGBA output,
+  // otherwise RGB.
+  PngStreamEncoder(uint32_t width, uint32_t height, bool alpha, int level, Sink sink);
+  ~PngStreamEncoder();
+
+  PngStreamEncoder(const PngStreamEncoder&) = delete;
+  PngStreamEncoder& operator=(const PngStreamEncoder&) = delete;
+
+  // Records where the image sits within a larger canvas as an oFFs chunk, in
+  // pixels. Must be called before the first row.
+  void WriteOffset(int32_t x, int32_t y);
+
+  // Appends rows of a premultiplied BGRA bitmap, as produced by Ultralight.
+  void WriteBgraRows(const uint8_t* pixels, uint32_t row_bytes, uint32_t rows);
+
+  // Writes the final IDAT and IEND. All `height` rows must have been written.
+  void Finish();
+
+  uint32_t rows_written() const { return rows_written_; }
+
+private:
+  void Deflate(const uint8_t* data, size_t size, int flush);
+
+  uint32_t height_;
+  Sink sink_;
+  z_stream stream_;
+  uint32_t rows_written_ = 0;
+  PngRowFilter filter_;
+  std::vector<uint8_t> out_;
+};
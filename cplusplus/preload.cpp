@@ -0,0 +1,143 @@
+#include "preload.h"
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace ultralight;
+
+static void NoopDestroyBuffer(void* user_data, void* data) {}
+
+bool MapFile(const std::string& path, MappedFile& out) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return false;
+  }
+
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return false;
+
+  out.data = data;
+  out.size = st.st_size;
+  return true;
+}
+
+PreloadedFileSystem::PreloadedFileSystem(const std::string& base_dir)
+    : base_dir_(base_dir), fallback_(GetPlatformFileSystem(base_dir.c_str())) {}
+
+PreloadedFileSystem::~PreloadedFileSystem() {
+  for (auto& pair : files_)
+    munmap(const_cast<void*>(pair.second.data), pair.second.size);
+}
+
+size_t PreloadedFileSystem::PreloadDirectory(const std::string& relative_dir) {
+  namespace fs = std::filesystem;
+
+  size_t total = 0;
+  std::error_code ec;
+  fs::path root = fs::path(base_dir_) / relative_dir;
+  for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+    if (!it->is_regular_file())
+      continue;
+
+    std::string relative = fs::relative(it->path(), base_dir_).generic_string();
+    MappedFile file;
+    if (files_.count(relative) || !MapFile(it->path().string(), file))
+      continue;
+
+    files_[relative] = file;
+    total += file.size;
+  }
+  return total;
+}
+
+bool PreloadedFileSystem::FileExists(const String& file_path) {
+  if (files_.count(file_path.utf8().data()))
+    return true;
+  return fallback_->FileExists(file_path);
+}
+
+String PreloadedFileSystem::GetFileMimeType(const String& file_path) {
+  return fallback_->GetFileMimeType(file_path);
+}
+
+String PreloadedFileSystem::GetFileCharset(const String& file_path) {
+  return fallback_->GetFileCharset(file_path);
+}
+
+RefPtr<Buffer> PreloadedFileSystem::OpenFile(const String& file_path) {
+  auto it = files_.find(file_path.utf8().data());
+  if (it == files_.end())
+    return fallback_->OpenFile(file_path);
+
+  return Buffer::Create(const_cast<void*>(it->second.data), it->second.size, nullptr,
+                        NoopDestroyBuffer);
+}
+
+PreloadedFontLoader::PreloadedFontLoader() : fallback_(GetPlatformFontLoader()) {}
+
+PreloadedFontLoader::~PreloadedFontLoader() {
+  for (auto& pair : fonts_)
+    munmap(const_cast<void*>(pair.second.data), pair.second.size);
+}
+
+size_t PreloadedFontLoader::Preload(const std::string& family) {
+  size_t total = 0;
+  for (int weight : { 400, 700 }) {
+    for (bool italic : { false, true }) {
+      auto key = std::make_tuple(family, weight, italic);
+      if (fonts_.count(key))
+        continue;
+
+      RefPtr<FontFile> font = fallback_->Load(String(family.c_str()), weight, italic);
+      if (!font)
+        continue;
+
+      MappedFile file;
+      if (font->is_in_memory()) {
+        RefPtr<Buffer> buffer = font->buffer();
+        void* copy = mmap(nullptr, buffer->size(), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (copy == MAP_FAILED)
+          continue;
+        memcpy(copy, buffer->data(), buffer->size());
+        mprotect(copy, buffer->size(), PROT_READ);
+        file.data = copy;
+        file.size = buffer->size();
+      } else if (!MapFile(font->filepath().utf8().data(), file)) {
+        continue;
+      }
+
+      fonts_[key] = file;
+      total += file.size;
+    }
+  }
+  return total;
+}
+
+String PreloadedFontLoader::fallback_font() const {
+  return fallback_->fallback_font();
+}
+
+String PreloadedFontLoader::fallback_font_for_characters(const String& characters, int weight,
+                                                         bool italic) const {
+  return fallback_->fallback_font_for_characters(characters, weight, italic);
+}
+
+RefPtr<FontFile> PreloadedFontLoader::Load(const String& family, int weight, bool italic) {
+  auto it = fonts_.find(std::make_tuple(std::string(family.utf8().data()), weight, italic));
+  if (it == fonts_.end())
+    return fallback_->Load(family, weight, italic);
+
+  return FontFile::Create(Buffer::Create(const_cast<void*>(it->second.data), it->second.size,
+                                         nullptr, NoopDestroyBuffer));
+}
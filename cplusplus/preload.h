@@ -0,0 +1,52 @@
+#pragma once
+#include <Ultralight/Ultralight.h>
+#include <AppCore/AppCore.h>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+
+// Read-only file mappings created before fork() so that every worker
+// process shares the same resident pages copy-on-write.
+struct MappedFile {
+  const void* data = nullptr;
+  size_t size = 0;
+};
+
+bool MapFile(const std::string& path, MappedFile& out);
+
+class PreloadedFileSystem : public ultralight::FileSystem {
+public:
+  explicit PreloadedFileSystem(const std::string& base_dir);
+  virtual ~PreloadedFileSystem();
+
+  size_t PreloadDirectory(const std::string& relative_dir);
+
+  virtual bool FileExists(const ultralight::String& file_path) override;
+  virtual ultralight::String GetFileMimeType(const ultralight::String& file_path) override;
+  virtual ultralight::String GetFileCharset(const ultralight::String& file_path) override;
+  virtual ultralight::RefPtr<ultralight::Buffer> OpenFile(const ultralight::String& file_path) override;
+
+private:
+  std::string base_dir_;
+  ultralight::FileSystem* fallback_;
+  std::unordered_map<std::string, MappedFile> files_;
+};
+
+class PreloadedFontLoader : public ultralight::FontLoader {
+public:
+  PreloadedFontLoader();
+  virtual ~PreloadedFontLoader();
+
+  size_t Preload(const std::string& family);
+
+  virtual ultralight::String fallback_font() const override;
+  virtual ultralight::String fallback_font_for_characters(const ultralight::String& characters,
+                                                          int weight, bool italic) const override;
+  virtual ultralight::RefPtr<ultralight::FontFile> Load(const ultralight::String& family,
+                                                        int weight, bool italic) override;
+
+private:
+  ultralight::FontLoader* fallback_;
+  std::map<std::tuple<std::string, int, bool>, MappedFile> fonts_;
+};
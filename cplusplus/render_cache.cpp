@@ -0,0 +1,247 @@
+#include "render_cache.h"
+#include "encoder_pool.h"
+#include "hash.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+std::string CacheKey::ToHex() const {
+  char out[33];
+  snprintf(out, sizeof(out), "%016llx%016llx", (unsigned long long)hi, (unsigned long long)lo);
+  return out;
+}
+
+CacheKeyBuilder& CacheKeyBuilder::Add(const void* data, size_t length) {
+  key_.hi = HashMix(key_.hi ^ Hash64(data, length, 0x9e3779b97f4a7c15ull), 0xff51afd7ed558ccdull);
+  key_.lo = HashMix(key_.lo ^ Hash64(data, length, 0xc2b2ae3d27d4eb4full), 0xc4ceb9fe1a85ec53ull);
+  return *this;
+}
+
+RenderCache& RenderCache::instance() {
+  static RenderCache cache;
+  return cache;
+}
+
+void RenderCache::Configure(const CacheOptions& options) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    options_ = options;
+    while (memory_used_ > options_.memory_bytes && !lru_.empty()) {
+      memory_used_ -= lru_.back().png->size();
+      index_.erase(lru_.back().key);
+      lru_.pop_back();
+    }
+  }
+
+  if (!options.disk_path.empty()) {
+    std::error_code ec;
+    fs::create_directories(options.disk_path, ec);
+
+    std::lock_guard<std::mutex> lock(disk_mutex_);
+    disk_used_ = 0;
+    for (fs::directory_iterator it(options.disk_path, ec), end; !ec && it != end; it.increment(ec)) {
+      if (it->is_regular_file())
+        disk_used_ += it->file_size();
+    }
+  }
+}
+
+void RenderCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  lru_.clear();
+  index_.clear();
+  memory_used_ = 0;
+}
+
+void RenderCache::GetOrRender(const CacheKey& key, const std::function<void(RenderDone)>& render,
+                              const LookupDone& done) {
+  CacheOptions options;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (PngData png = LookupMemory(key)) {
+      lock.unlock();
+      done(png, CacheStatus::MemoryHit, nullptr);
+      return;
+    }
+
+    auto it = inflight_.find(key);
+    if (it != inflight_.end()) {
+      it->second.push_back([done](PngData png, std::exception_ptr error) {
+        done(png, CacheStatus::Coalesced, error);
+      });
+      return;
+    }
+
+    inflight_[key];
+    options = options_;
+  }
+
+  PngData png;
+  try {
+    png = LoadDisk(key, options);
+  } catch (...) {
+    Finish(key, nullptr, CacheStatus::Miss, std::current_exception(), options, done);
+    return;
+  }
+  if (png) {
+    Finish(key, png, CacheStatus::DiskHit, nullptr, options, done);
+    return;
+  }
+
+  try {
+    render([this, key, options, done](PngData png, std::exception_ptr error) {
+      Finish(key, png, CacheStatus::Miss, error, options, done);
+    });
+  } catch (...) {
+    Finish(key, nullptr, CacheStatus::Miss, std::current_exception(), options, done);
+  }
+}
+
+void RenderCache::Finish(const CacheKey& key, PngData png, CacheStatus status, std::exception_ptr error,
+                         const CacheOptions& options, const LookupDone& done) {
+  std::vector<RenderDone> waiters;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (png)
+      InsertMemory(key, png);
+    auto it = inflight_.find(key);
+    if (it != inflight_.end()) {
+      waiters = std::move(it->second);
+      inflight_.erase(it);
+    }
+  }
+
+  for (const RenderDone& waiter : waiters)
+    waiter(png, error);
+  done(png, status, error);
+
+  // Usually called on the RenderThread, which should not wait on the disk.
+  if (png && status == CacheStatus::Miss && !options.disk_path.empty())
+    EncoderPool::instance().Submit([this, key, png, options] { StoreDisk(key, png, options); });
+}
+
+PngData RenderCache::LookupMemory(const CacheKey& key) {
+  auto it = index_.find(key);
+  if (it == index_.end())
+    return nullptr;
+
+  if (it->second->expires <= Clock::now()) {
+    memory_used_ -= it->second->png->size();
+    lru_.erase(it->second);
+    index_.erase(it);
+    return nullptr;
+  }
+
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return it->second->png;
+}
+
+void RenderCache::InsertMemory(const CacheKey& key, PngData png) {
+  if (png->size() > options_.memory_bytes)
+    return;
+
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    memory_used_ -= it->second->png->size();
+    lru_.erase(it->second);
+    index_.erase(it);
+  }
+
+  while (memory_used_ + png->size() > options_.memory_bytes && !lru_.empty()) {
+    memory_used_ -= lru_.back().png->size();
+    index_.erase(lru_.back().key);
+    lru_.pop_back();
+  }
+
+  memory_used_ += png->size();
+  lru_.push_front({ key, png, Clock::now() + std::chrono::milliseconds(options_.ttl_ms) });
+  index_[key] = lru_.begin();
+}
+
+PngData RenderCache::LoadDisk(const CacheKey& key, const CacheOptions& options) {
+  if (options.disk_path.empty())
+    return nullptr;
+
+  std::string path = options.disk_path + "/" + key.ToHex() + ".png";
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return nullptr;
+
+  if (difftime(time(nullptr), st.st_mtime) * 1000.0 > options.ttl_ms) {
+    std::lock_guard<std::mutex> lock(disk_mutex_);
+    if (unlink(path.c_str()) == 0)
+      disk_used_ -= std::min<size_t>(disk_used_, st.st_size);
+    return nullptr;
+  }
+
+  std::ifstream file(path, std::ios::binary);
+  auto data = std::make_shared<std::vector<uint8_t>>(st.st_size);
+  if (!file.read(reinterpret_cast<char*>(data->data()), data->size()))
+    return nullptr;
+  return data;
+}
+
+void RenderCache::StoreDisk(const CacheKey& key, const PngData& png, const CacheOptions& options) {
+  if (options.disk_path.empty() || png->size() > options.disk_bytes)
+    return;
+
+  std::string path = options.disk_path + "/" + key.ToHex() + ".png";
+  std::string temp_path = path + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    if (!file.write(reinterpret_cast<const char*>(png->data()), png->size()))
+      return;
+  }
+  if (rename(temp_path.c_str(), path.c_str()) != 0) {
+    unlink(temp_path.c_str());
+    return;
+  }
+
+  bool over_budget;
+  {
+    std::lock_guard<std::mutex> lock(disk_mutex_);
+    disk_used_ += png->size();
+    over_budget = disk_used_ > options.disk_bytes;
+  }
+  if (over_budget)
+    TrimDisk(options);
+}
+
+void RenderCache::TrimDisk(const CacheOptions& options) {
+  struct DiskEntry {
+    fs::path path;
+    time_t mtime;
+    size_t size;
+  };
+
+  std::vector<DiskEntry> entries;
+  size_t total = 0;
+  std::error_code ec;
+  for (fs::directory_iterator it(options.disk_path, ec), end; !ec && it != end; it.increment(ec)) {
+    struct stat st;
+    if (!it->is_regular_file() || stat(it->path().c_str(), &st) != 0)
+      continue;
+    entries.push_back({ it->path(), st.st_mtime, (size_t)st.st_size });
+    total += st.st_size;
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const DiskEntry& a, const DiskEntry& b) { return a.mtime < b.mtime; });
+
+  size_t target = options.disk_bytes / 10 * 9;
+  for (const auto& entry : entries) {
+    if (total <= target)
+      break;
+    if (fs::remove(entry.path, ec))
+      total -= entry.size;
+  }
+
+  std::lock_guard<std::mutex> lock(disk_mutex_);
+  disk_used_ = total;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "png_stream.h"
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CacheKey {
+  uint64_t hi = 0;
+  uint64_t lo = 0;
+
+  bool operator==(const CacheKey& other) const { return hi == other.hi && lo == other.lo; }
+  std::string ToHex() const;
+};
+
+struct CacheKeyHash {
+  size_t operator()(const CacheKey& key) const { return (size_t)key.lo; }
+};
+
+class CacheKeyBuilder {
+public:
+  CacheKeyBuilder& Add(const void* data, size_t length);
+  CacheKeyBuilder& Add(const std::string& value) { return Add(value.data(), value.size()); }
+  CacheKeyBuilder& Add(uint64_t value) { return Add(&value, sizeof(value)); }
+  CacheKey key() const { return key_; }
+
+private:
+  CacheKey key_;
+};
+
+struct CacheOptions {
+  size_t memory_bytes = 64 * 1024 * 1024;
+  std::string disk_path;
+  size_t disk_bytes = 512 * 1024 * 1024;
+  uint32_t ttl_ms = 60 * 1000;
+};
+
+enum class CacheStatus {
+  Miss,
+  MemoryHit,
+  DiskHit,
+  Coalesced,
+};
+
+// Two-tier (memory LRU + optional directory) cache of encoded renders with
+// singleflight: concurrent lookups of the same key wait on one render.
+class RenderCache {
+public:
+  using RenderDone = std::function<void(PngData png, std::exception_ptr error)>;
+  using LookupDone = std::function<void(PngData png, CacheStatus status, std::exception_ptr error)>;
+
+  static RenderCache& instance();
+
+  void Configure(const CacheOptions& options);
+  void Clear();
+
+  // Calls `done` with the cached PNG, or with the result `render` reports to
+  // the callback it is handed. Nothing blocks: lookups of a key that is
+  // already rendering wait as callbacks on that render. Disk reads happen on
+  // the calling thread, and `done` runs there for hits or on the thread that
+  // finished the render. New entries are written to disk on the EncoderPool.
+  void GetOrRender(const CacheKey& key, const std::function<void(RenderDone)>& render,
+                   const LookupDone& done);
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Entry {
+    CacheKey key;
+    PngData png;
+    Clock::time_point expires;
+  };
+
+  void Finish(const CacheKey& key, PngData png, CacheStatus status, std::exception_ptr error,
+              const CacheOptions& options, const LookupDone& done);
+  PngData LookupMemory(const CacheKey& key);
+  void InsertMemory(const CacheKey& key, PngData png);
+  PngData LoadDisk(const CacheKey& key, const CacheOptions& options);
+  void StoreDisk(const CacheKey& key, const PngData& png, const CacheOptions& options);
+  void TrimDisk(const CacheOptions& options);
+
+  std::mutex mutex_;
+  CacheOptions options_;
+  std::list<Entry> lru_;
+  std::unordered_map<CacheKey, std::list<Entry>::iterator, CacheKeyHash> index_;
+  size_t memory_used_ = 0;
+  std::unordered_map<CacheKey, std::vector<RenderDone>, CacheKeyHash> inflight_;
+
+  std::mutex disk_mutex_;
+  size_t disk_used_ = 0;
+};
@@ -0,0 +1,338 @@
+#include "render_service.h"
+#include "metrics.h"
+#include "render_thread.h"
+#include "tracer.h"
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
+
+using namespace ultralight;
+
+static bool MatchesNoCase(const std::string& text, size_t pos, const char* word) {
+  size_t length = strlen(word);
+  if (pos + length > text.size())
+    return false;
+  for (size_t i = 0; i < length; i++) {
+    if (tolower((unsigned char)text[pos + i]) != word[i])
+      return false;
+  }
+  return true;
+}
+
+bool IsStaticHtml(const std::string& html) {
+  bool in_tag = false;
+  for (size_t i = 0; i < html.size(); i++) {
+    char c = html[i];
+    if (c == '<') {
+      if (MatchesNoCase(html, i + 1, "script"))
+        return false;
+      in_tag = true;
+    } else if (c == '>') {
+      in_tag = false;
+    } else if ((c == 'j' || c == 'J') && MatchesNoCase(html, i, "javascript:")) {
+      return false;
+    } else if (in_tag && isspace((unsigned char)c) && MatchesNoCase(html, i + 1, "on")) {
+      // Attribute named on<letters>, optionally followed by spaces, then '='.
+      size_t j = i + 3;
+      while (j < html.size() && isalpha((unsigned char)html[j]))
+        j++;
+      while (j < html.size() && isspace((unsigned char)html[j]))
+        j++;
+      if (j > i + 3 && j < html.size() && html[j] == '=')
+        return false;
+    }
+  }
+  return true;
+}
+
+static CacheKey MakeCacheKey(const RenderRequest& request) {
+  TraceScope trace("CacheKey");
+  CacheKeyBuilder builder;
+  builder.Add((uint64_t)request.with_images)
+      .Add((uint64_t)request.width)
+      .Add((uint64_t)request.height)
+      .Add(request.profile.Key())
+      .Add(&request.capture.scale, sizeof(request.capture.scale))
+      .Add((uint64_t)request.capture.full_page)
+      .Add((uint64_t)request.capture.tile_height)
+      .Add(request.capture.selector)
+      .Add((uint64_t)request.capture.trim)
+      .Add((uint64_t)request.capture.animation_duration_ms)
+      .Add((uint64_t)request.capture.animation_fps)
+      .Add(request.network.Key())
+      .Add(request.html);
+
+  for (const auto& pair : request.imagePaths) {
+    builder.Add(pair.first);
+
+    std::ifstream file(pair.second, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    builder.Add(file ? contents : pair.second);
+  }
+
+  return builder.key();
+}
+
+static PngData CopyBuffer(const RefPtr<Buffer>& buffer) {
+  const uint8_t* data = static_cast<const uint8_t*>(buffer->data());
+  return std::make_shared<const std::vector<uint8_t>>(data, data + buffer->size());
+}
+
+// A request on its way through the service, shared by the callbacks that
+// carry it from the calling thread to the RenderThread and back.
+struct RenderJob {
+  RenderRequest request;
+  ViewProfile profile;
+  RenderResponse response;
+  // Set for streamed renders.
+  PngStreamEncoder::Sink sink;
+  RenderCallback done;
+};
+
+// Runs the request on the RenderThread and reports the PNG to `rendered`
+// there. Streamed renders pass it to job->sink instead, and requests with
+// output sizes or viewports append theirs to job->response.pngs; both
+// report null. Engine buffers are copied before they leave the thread.
+static void RenderOnThread(const std::shared_ptr<RenderJob>& job, RenderCache::RenderDone rendered) {
+  RenderThread::instance().Dispatch([job, rendered](MyApp& app) {
+    const RenderRequest& request = job->request;
+    RenderTimings& timings = job->response.timings;
+    bool has_outputs = !request.capture.sizes.empty() || !request.capture.viewports.empty();
+    std::vector<RefPtr<Buffer>> outputs;
+
+    timings.started = RenderTimings::Clock::now();
+    timings.bytes_in = request.html.size();
+    app.set_timings(&timings);
+    app.set_stream_sink(job->sink ? &job->sink : nullptr);
+    app.set_outputs(has_outputs ? &outputs : nullptr);
+    app.set_network_policy(&request.network);
+
+    PngData png;
+    std::exception_ptr error;
+    try {
+      String html_string_ul(request.html.c_str());
+      RefPtr<Buffer> buffer;
+      if (request.with_images)
+        buffer = app.RunWithImages(html_string_ul, request.imagePaths, request.width, request.height,
+                                   job->profile, request.capture);
+      else
+        buffer = app.Run(html_string_ul, request.width, request.height, job->profile, request.capture);
+
+      for (const auto& output : outputs)
+        job->response.pngs.push_back(CopyBuffer(output));
+      if (buffer)
+        png = CopyBuffer(buffer);
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    app.set_timings(nullptr);
+    app.set_stream_sink(nullptr);
+    app.set_outputs(nullptr);
+    app.set_network_policy(nullptr);
+    rendered(png, error);
+  });
+}
+
+// Records a finished render in Metrics, counting timeouts separately.
+static void RecordOutcome(const RenderTimings& timings, CacheStatus cache, bool ok,
+                          const std::exception_ptr& error) {
+  if (error) {
+    try {
+      std::rethrow_exception(error);
+    } catch (const RenderTimeoutError&) {
+      Metrics::instance().timeouts.fetch_add(1, std::memory_order_relaxed);
+    } catch (...) {
+    }
+  }
+  Metrics::instance().RecordRender(timings, cache, ok && !error);
+}
+
+static uint32_t ReadU32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Reads the crop of a trimmed capture back from its IHDR and oFFs chunks, so
+// cached results report it too.
+static bool ReadPngCrop(const PngData& png, PixelRect& rect) {
+  const std::vector<uint8_t>& bytes = *png;
+  bool found = false;
+  for (size_t pos = 8; pos + 12 <= bytes.size();) {
+    const uint8_t* chunk = bytes.data() + pos;
+    uint32_t length = ReadU32(chunk);
+    if (pos + 12 + (size_t)length > bytes.size() || !memcmp(chunk + 4, "IDAT", 4))
+      break;
+    if (!memcmp(chunk + 4, "IHDR", 4) && length >= 8) {
+      rect.width = ReadU32(chunk + 8);
+      rect.height = ReadU32(chunk + 12);
+    } else if (!memcmp(chunk + 4, "oFFs", 4) && length >= 8) {
+      rect.x = ReadU32(chunk + 8);
+      rect.y = ReadU32(chunk + 12);
+      found = true;
+    }
+    pos += 12 + (size_t)length;
+  }
+  return found;
+}
+
+static ViewProfile SelectProfile(const RenderRequest& request, RenderResponse& response) {
+  ViewProfile profile = request.profile;
+  if (profile.enable_javascript && request.static_fast_path && !request.capture.full_page &&
+      !request.capture.tile_height && request.capture.selector.empty() &&
+      !request.capture.animation_duration_ms && IsStaticHtml(request.html)) {
+    profile.enable_javascript = false;
+    response.static_fast_path = true;
+  }
+  return profile;
+}
+
+static void FinishRender(const std::shared_ptr<RenderJob>& job, std::exception_ptr error) {
+  const RenderRequest& request = job->request;
+  RenderResponse& response = job->response;
+  if (response.png)
+    response.timings.bytes_out = response.png->size();
+  if (response.png && request.capture.trim)
+    response.trimmed = ReadPngCrop(response.png, response.crop);
+  for (const PngData& png : response.pngs)
+    response.timings.bytes_out += png->size();
+
+  bool ok = job->sink || response.png != nullptr || !response.pngs.empty();
+  RecordOutcome(response.timings, response.cache, ok, error);
+  job->done(std::move(response), error);
+}
+
+void ProcessRenderRequestAsync(RenderRequest request, RenderCallback done) {
+  TraceScope trace("ProcessRenderRequest");
+  auto job = std::make_shared<RenderJob>();
+  job->request = std::move(request);
+  job->done = std::move(done);
+  job->response.timings.enqueued = RenderTimings::Clock::now();
+  job->profile = SelectProfile(job->request, job->response);
+
+  const RenderRequest& r = job->request;
+  if (!r.capture.sizes.empty() || !r.capture.viewports.empty() || !r.use_cache) {
+    RenderOnThread(job, [job](PngData png, std::exception_ptr error) {
+      job->response.png = png;
+      FinishRender(job, error);
+    });
+    return;
+  }
+
+  RenderCache::instance().GetOrRender(
+      MakeCacheKey(r), [job](RenderCache::RenderDone rendered) { RenderOnThread(job, std::move(rendered)); },
+      [job](PngData png, CacheStatus status, std::exception_ptr error) {
+        job->response.png = png;
+        job->response.cache = status;
+        FinishRender(job, error);
+      });
+}
+
+void StreamRenderRequestAsync(RenderRequest request, PngStreamEncoder::Sink sink, RenderCallback done) {
+  TraceScope trace("StreamRenderRequest");
+  auto job = std::make_shared<RenderJob>();
+  job->request = std::move(request);
+  job->done = std::move(done);
+  job->response.timings.enqueued = RenderTimings::Clock::now();
+  job->profile = SelectProfile(job->request, job->response);
+
+  // Not the shared_ptr: the job owns its sink.
+  RenderJob* raw = job.get();
+  job->sink = [raw, sink = std::move(sink)](const uint8_t* data, size_t size) {
+    raw->response.timings.bytes_out += size;
+    sink(data, size);
+  };
+  RenderOnThread(job, [job](PngData, std::exception_ptr error) { FinishRender(job, error); });
+}
+
+// Starts the request and blocks until it reports back.
+static RenderResponse WaitFor(const std::function<void(RenderCallback)>& start) {
+  auto promise = std::make_shared<std::promise<RenderResponse>>();
+  std::future<RenderResponse> future = promise->get_future();
+  start([promise](RenderResponse response, std::exception_ptr error) {
+    if (error)
+      promise->set_exception(error);
+    else
+      promise->set_value(std::move(response));
+  });
+  return future.get();
+}
+
+RenderResponse ProcessRenderRequest(const RenderRequest& request) {
+  return WaitFor([&](RenderCallback done) { ProcessRenderRequestAsync(request, std::move(done)); });
+}
+
+RenderResponse StreamRenderRequest(const RenderRequest& request, const PngStreamEncoder::Sink& sink) {
+  return WaitFor([&](RenderCallback done) { StreamRenderRequestAsync(request, sink, std::move(done)); });
+}
+
+struct TemplateJob {
+  TemplateRequest request;
+  TemplateResponse response;
+  TemplateCallback done;
+};
+
+// Runs a template render on the RenderThread with ProcessRenderRequest's
+// bookkeeping and reports it to job->done there. `render` returns whether
+// it produced output. Templates bypass the cache, so they count as misses.
+static void RunTemplateJob(const std::shared_ptr<TemplateJob>& job,
+                           std::function<bool(MyApp&, TemplateJob&)> render) {
+  RenderTimings& timings = job->response.timings;
+  timings.enqueued = RenderTimings::Clock::now();
+  timings.bytes_in = job->request.json.size();
+  for (const TemplateBinary& binary : job->request.binaries)
+    timings.bytes_in += binary.bytes.size();
+
+  RenderThread::instance().Dispatch([job, render](MyApp& app) {
+    RenderTimings& timings = job->response.timings;
+    timings.started = RenderTimings::Clock::now();
+    app.set_timings(&timings);
+
+    bool ok = false;
+    std::exception_ptr error;
+    try {
+      ok = render(app, *job);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    app.set_timings(nullptr);
+
+    RecordOutcome(timings, CacheStatus::Miss, ok, error);
+    job->done(std::move(job->response), error);
+  });
+}
+
+void ProcessTemplateRequestAsync(TemplateRequest request, TemplateCallback done) {
+  TraceScope trace("ProcessTemplateRequest");
+  auto job = std::make_shared<TemplateJob>();
+  job->request = std::move(request);
+  job->done = std::move(done);
+  RunTemplateJob(job, [](MyApp& app, TemplateJob& job) {
+    TemplateRequest& request = job.request;
+    RefPtr<Buffer> buffer = app.RenderTemplate(request.id, request.json, std::move(request.binaries),
+                                               request.width, request.height, request.capture);
+    if (!buffer)
+      return false;
+    job.response.png = CopyBuffer(buffer);
+    job.response.timings.bytes_out = job.response.png->size();
+    return true;
+  });
+}
+
+void ProcessTemplateDeltaRequestAsync(TemplateRequest request, TemplateCallback done) {
+  TraceScope trace("ProcessTemplateDeltaRequest");
+  auto job = std::make_shared<TemplateJob>();
+  job->request = std::move(request);
+  job->done = std::move(done);
+  RunTemplateJob(job, [](MyApp& app, TemplateJob& job) {
+    TemplateRequest& request = job.request;
+    job.response.delta = app.RenderTemplateDelta(request.id, request.json, std::move(request.binaries),
+                                                 request.width, request.height, request.capture.scale,
+                                                 request.delta);
+    for (const PngData& patch : job.response.delta.patches)
+      job.response.timings.bytes_out += patch->size();
+    return true;
+  });
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "my_app.h"
+#include "render_cache.h"
+#include "timings.h"
+#include <exception>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+struct RenderRequest {
+  std::string html;
+  uint32_t width = 1600;
+  uint32_t height = 800;
+  bool with_images = false;
+  std::map<std::string, std::string> imagePaths;
+  bool use_cache = true;
+  bool return_timings = false;
+  ViewProfile profile;
+  CaptureOptions capture;
+  // Narrows the process-wide policy for this render.
+  NetworkPolicy network;
+  // Render markup without <script> or inline handlers with JavaScript off.
+  // Not applied to full-page, tiled or selector captures, which measure or
+  // scroll the page with scripts.
+  bool static_fast_path = true;
+};
+
+struct RenderResponse {
+  PngData png;
+  // One PNG per RenderRequest::capture.sizes or viewports entry, in order.
+  // `png` is null for such requests.
+  std::vector<PngData> pngs;
+  // Area of the surface a trimmed capture kept, in device pixels.
+  bool trimmed = false;
+  PixelRect crop;
+  CacheStatus cache = CacheStatus::Miss;
+  RenderTimings timings;
+  bool static_fast_path = false;
+};
+
+// A render of a registered template. A width or height of 0 keeps the
+// template's current size.
+struct TemplateRequest {
+  std::string id;
+  std::string json;
+  std::vector<TemplateBinary> binaries;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  CaptureOptions capture;
+  // Only used by ProcessTemplateDeltaRequest.
+  DeltaOptions delta;
+};
+
+struct TemplateResponse {
+  // Set by ProcessTemplateRequest.
+  PngData png;
+  // Set by ProcessTemplateDeltaRequest.
+  TemplateDelta delta;
+  RenderTimings timings;
+};
+
+// True if the markup contains no <script>, inline on* handler or
+// javascript: URL, so it renders the same with JavaScript disabled.
+bool IsStaticHtml(const std::string& html);
+
+using RenderCallback = std::function<void(RenderResponse response, std::exception_ptr error)>;
+using TemplateCallback = std::function<void(TemplateResponse response, std::exception_ptr error)>;
+
+// Looks the request up in the RenderCache and, on a miss, renders it on the
+// RenderThread. Requests with output sizes or viewports bypass the cache.
+// Returns at once; `done` runs on the RenderThread once the render has
+// finished, or on the calling thread for cache hits. Cache key and disk
+// reads happen on the calling thread.
+void ProcessRenderRequestAsync(RenderRequest request, RenderCallback done);
+
+// Renders the request on the RenderThread, bypassing the cache, and passes
+// the PNG to `sink` in chunks as it is encoded. The sink and `done` run on
+// the RenderThread; the response passed to `done` has no png.
+void StreamRenderRequestAsync(RenderRequest request, PngStreamEncoder::Sink sink, RenderCallback done);
+
+// Blocking versions of the above, for callers with a thread to spare.
+RenderResponse ProcessRenderRequest(const RenderRequest& request);
+RenderResponse StreamRenderRequest(const RenderRequest& request, const PngStreamEncoder::Sink& sink);
+
+// Render a registered template on the RenderThread, with the same timings
+// and metrics as ProcessRenderRequest. Template renders are never cached.
+// Return at once; `done` runs on the RenderThread.
+void ProcessTemplateRequestAsync(TemplateRequest request, TemplateCallback done);
+void ProcessTemplateDeltaRequestAsync(TemplateRequest request, TemplateCallback done);
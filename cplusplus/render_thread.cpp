@@ -0,0 +1,58 @@
+#include "render_thread.h"
+#include "metrics.h"
+
+RenderThread& RenderThread::instance() {
+  static RenderThread thread;
+  return thread;
+}
+
+RenderThread::RenderThread() {
+  thread_ = std::thread([this] { Loop(); });
+}
+
+RenderThread::~RenderThread() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void RenderThread::Enqueue(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(std::move(job));
+  }
+  Metrics::instance().queue_depth.fetch_add(1, std::memory_order_relaxed);
+  cv_.notify_one();
+}
+
+void RenderThread::Loop() {
+  // Platform setup and Renderer::Create() happen here, at module load,
+  // instead of on the first request.
+  Tracer::instance().SetThreadName("render");
+  app_.reset(new MyApp());
+
+  for (;;) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!cv_.wait_for(lock, std::chrono::seconds(1), [this] { return stop_ || !jobs_.empty(); })) {
+        lock.unlock();
+        app_->OnIdle();
+        continue;
+      }
+      if (stop_ && jobs_.empty())
+        break;
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    Metrics::instance().queue_depth.fetch_sub(1, std::memory_order_relaxed);
+    job();
+    app_->AfterJob();
+  }
+
+  app_.reset();
+}
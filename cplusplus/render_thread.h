@@ -0,0 +1,71 @@
+#pragma once
+#include "async_logger.h"
+#include "my_app.h"
+#include "tracer.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+// Owns the MyApp instance on a dedicated thread. Ultralight requires the
+// Renderer and its Views to be used from the thread that created them, so
+// every render is posted here as a job.
+class RenderThread {
+public:
+  static RenderThread& instance();
+
+  template <typename F>
+  auto Post(F&& job) -> std::future<std::invoke_result_t<F&, MyApp&>>;
+
+  // Like Post, for jobs that report their own result, so no thread has to
+  // wait on a future. The job must not throw.
+  template <typename F>
+  void Dispatch(F&& job);
+
+  bool is_ready() const { return ready_.load(std::memory_order_acquire); }
+  void set_ready(bool ready) { ready_.store(ready, std::memory_order_release); }
+
+private:
+  RenderThread();
+  ~RenderThread();
+
+  void Enqueue(std::function<void()> job);
+  void Loop();
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> jobs_;
+  bool stop_ = false;
+  std::unique_ptr<MyApp> app_;
+  std::atomic<bool> ready_{false};
+  std::atomic<uint64_t> next_job_{1};
+};
+
+template <typename F>
+auto RenderThread::Post(F&& job) -> std::future<std::invoke_result_t<F&, MyApp&>> {
+  using Result = std::invoke_result_t<F&, MyApp&>;
+  auto task = std::make_shared<std::packaged_task<Result()>>(
+      [this, id = next_job_++, job = std::forward<F>(job)]() mutable {
+        AsyncLogger::JobScope scope(id);
+        TraceScope trace("RenderJob");
+        return job(*app_);
+      });
+  std::future<Result> future = task->get_future();
+  Enqueue([task] { (*task)(); });
+  return future;
+}
+
+template <typename F>
+void RenderThread::Dispatch(F&& job) {
+  Enqueue([this, id = next_job_++, job = std::forward<F>(job)]() mutable {
+    AsyncLogger::JobScope scope(id);
+    TraceScope trace("RenderJob");
+    job(*app_);
+  });
+}
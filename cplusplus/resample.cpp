@@ -0,0 +1,122 @@
+#include "resample.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+static const int kWeightBits = 14;
+static const int kWeightOne = 1 << kWeightBits;
+static const double kPi = 3.14159265358979323846;
+
+static double Lanczos3(double x) {
+  x = std::fabs(x);
+  if (x < 1e-8)
+    return 1.0;
+  if (x >= 3.0)
+    return 0.0;
+  double px = kPi * x;
+  return 3.0 * std::sin(px) * std::sin(px / 3.0) / (px * px);
+}
+
+// Every output index reads `taps` consecutive source indices starting at
+// first[i]; weights outside the filter's support are zero. A fixed tap count
+// keeps the loops free of per-pixel bounds.
+struct FilterTaps {
+  uint32_t taps = 0;
+  std::vector<uint32_t> first;
+  std::vector<int32_t> weights;
+};
+
+static FilterTaps ComputeTaps(uint32_t src_size, uint32_t dst_size) {
+  double scale = (double)src_size / dst_size;
+  double filter_scale = std::max(scale, 1.0);
+  double support = 3.0 * filter_scale;
+
+  FilterTaps filter;
+  filter.taps = std::min<uint32_t>(src_size, (uint32_t)std::ceil(support) * 2 + 1);
+  filter.first.resize(dst_size);
+  filter.weights.assign((size_t)dst_size * filter.taps, 0);
+
+  std::vector<double> weights(filter.taps);
+  for (uint32_t i = 0; i < dst_size; i++) {
+    double center = (i + 0.5) * scale;
+    long left = std::max(0L, (long)std::floor(center - support));
+    long right = std::min((long)src_size, (long)std::ceil(center + support));
+    long first = std::max(0L, std::min(left, (long)src_size - (long)filter.taps));
+    right = std::min(right, first + (long)filter.taps);
+
+    double total = 0;
+    for (uint32_t k = 0; k < filter.taps; k++) {
+      long j = first + k;
+      weights[k] = j >= left && j < right ? Lanczos3((j + 0.5 - center) / filter_scale) : 0.0;
+      total += weights[k];
+    }
+
+    // Normalize, then put the rounding error on the largest tap so every
+    // row of weights sums to exactly one.
+    int32_t* out = &filter.weights[(size_t)i * filter.taps];
+    int32_t sum = 0;
+    uint32_t largest = 0;
+    for (uint32_t k = 0; k < filter.taps; k++) {
+      out[k] = (int32_t)std::lround(weights[k] / total * kWeightOne);
+      sum += out[k];
+      if (out[k] > out[largest])
+        largest = k;
+    }
+    out[largest] += kWeightOne - sum;
+    filter.first[i] = (uint32_t)first;
+  }
+  return filter;
+}
+
+static inline uint8_t ClampToByte(int32_t value) {
+  value = (value + (kWeightOne >> 1)) >> kWeightBits;
+  return (uint8_t)std::min(255, std::max(0, value));
+}
+
+void ResampleBgra(const uint8_t* src, uint32_t src_width, uint32_t src_height, uint32_t src_row_bytes,
+                  uint8_t* dst, uint32_t dst_width, uint32_t dst_height, uint32_t dst_row_bytes) {
+  FilterTaps rows = ComputeTaps(src_height, dst_height);
+  FilterTaps columns = ComputeTaps(src_width, dst_width);
+
+  size_t row_size = (size_t)src_width * 4;
+  std::vector<int32_t> accumulator(row_size);
+  std::vector<uint8_t> row(row_size);
+
+  for (uint32_t y = 0; y < dst_height; y++) {
+    // Vertical pass into one source-width row.
+    std::fill(accumulator.begin(), accumulator.end(), 0);
+    const int32_t* row_weights = &rows.weights[(size_t)y * rows.taps];
+    for (uint32_t k = 0; k < rows.taps; k++) {
+      int32_t weight = row_weights[k];
+      if (!weight)
+        continue;
+      const uint8_t* in = src + (size_t)(rows.first[y] + k) * src_row_bytes;
+      int32_t* acc = accumulator.data();
+      for (size_t x = 0; x < row_size; x++)
+        acc[x] += weight * in[x];
+    }
+    for (size_t x = 0; x < row_size; x++)
+      row[x] = ClampToByte(accumulator[x]);
+
+    // Horizontal pass, four channels per pixel.
+    uint8_t* out = dst + (size_t)y * dst_row_bytes;
+    for (uint32_t x = 0; x < dst_width; x++, out += 4) {
+      const int32_t* column_weights = &columns.weights[(size_t)x * columns.taps];
+      const uint8_t* in = row.data() + (size_t)columns.first[x] * 4;
+      int32_t b = 0, g = 0, r = 0, a = 0;
+      for (uint32_t k = 0; k < columns.taps; k++, in += 4) {
+        int32_t weight = column_weights[k];
+        b += weight * in[0];
+        g += weight * in[1];
+        r += weight * in[2];
+        a += weight * in[3];
+      }
+      // Lanczos rings; keep the result valid premultiplied alpha.
+      uint8_t alpha = ClampToByte(a);
+      out[0] = std::min(ClampToByte(b), alpha);
+      out[1] = std::min(ClampToByte(g), alpha);
+      out[2] = std::min(ClampToByte(r), alpha);
+      out[3] = alpha;
+    }
+  }
+}
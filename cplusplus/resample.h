@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+
+// Resizes a premultiplied BGRA image with a separable Lanczos-3 filter whose
+// support widens with the downscale factor, so large reductions average every
+// source pixel instead of skipping rows. Weights are 14-bit fixed point and
+// the inner loops run over contiguous bytes, so the compiler vectorizes them.
+// Works one output row at a time with two source-width rows of scratch.
+void ResampleBgra(const uint8_t* src, uint32_t src_width, uint32_t src_height, uint32_t src_row_bytes,
+                  uint8_t* dst, uint32_t dst_width, uint32_t dst_height, uint32_t dst_row_bytes);
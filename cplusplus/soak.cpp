@@ -0,0 +1,410 @@
+// Soak and leak test. Cycles the benchmark corpus through the addon's render
+// paths (buffered and streamed, with and without image uploads, plus requests
+// that are meant to fail) for a fixed time or number of renders, samples
+// memory periodically and fits a line through RSS over renders. Exits 1 when
+// RSS grows by more than --max-bytes-per-render once warmed up, or when a
+// render that should succeed fails.
+//
+//   soak [--corpus DIR] [--duration SECONDS] [--renders N] [--concurrency N]
+//        [--sample-every SECONDS] [--warmup-renders N] [--max-bytes-per-render N]
+//        [--stream-every N] [--fail-every N] [--filter NAME] [--json FILE|-]
+//        [--label TEXT]
+//
+// Run from the directory that contains assets/, like the addon. Ctrl-C stops
+// the run early and still prints the report.
+
+#include "async_logger.h"
+#include "bench_corpus.h"
+#include "engine_heap.h"
+#include "memory_governor.h"
+#include "metrics.h"
+#include "render_service.h"
+#include "render_thread.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+struct SoakOptions {
+  std::string corpus = "cplusplus/bench/corpus";
+  double duration_seconds = 3600;
+  uint64_t renders = 0;
+  uint32_t concurrency = 2;
+  double sample_seconds = 30;
+  // Pools, caches and allocator arenas fill up first; samples taken before
+  // this many renders are left out of the fit.
+  uint64_t warmup_renders = 2000;
+  double max_bytes_per_render = 256;
+  uint32_t stream_every = 4;
+  uint32_t fail_every = 25;
+  std::string filter;
+  std::string json;
+  std::string label;
+};
+
+enum class RequestKind { Buffered, Streamed, OversizedSurface, MissingSelector };
+
+struct Sample {
+  double seconds = 0;
+  uint64_t renders = 0;
+  uint64_t rss_bytes = 0;
+  uint64_t engine_memory_bytes = 0;
+  uint64_t engine_heap_live_bytes = 0;
+  uint64_t malloc_arena_bytes = 0;
+  uint64_t malloc_free_bytes = 0;
+  // Renders per second since the previous sample.
+  double throughput_rps = 0;
+};
+
+struct Fit {
+  size_t samples = 0;
+  double slope = 0;
+};
+
+static std::atomic<bool> g_interrupted{false};
+
+static void OnSignal(int) {
+  g_interrupted = true;
+}
+
+// Every fail_every-th request is one the service has to reject, alternating
+// between one refused before loading and one that fails after the page
+// loaded. Of the rest, every stream_every-th is streamed.
+static RequestKind KindFor(uint64_t index, const SoakOptions& options) {
+  if (options.fail_every && index % options.fail_every == options.fail_every - 1)
+    return (index / options.fail_every) % 2 ? RequestKind::MissingSelector : RequestKind::OversizedSurface;
+  if (options.stream_every && index % options.stream_every == 0)
+    return RequestKind::Streamed;
+  return RequestKind::Buffered;
+}
+
+static RenderRequest MakeRequest(const BenchCase& bench_case, RequestKind kind) {
+  RenderRequest request;
+  request.html = bench_case.html;
+  request.width = bench_case.width;
+  request.height = bench_case.height;
+  request.with_images = !bench_case.images.empty();
+  request.imagePaths = bench_case.images;
+  request.use_cache = false;
+
+  if (kind == RequestKind::OversizedSurface) {
+    request.width = 65536;
+    request.height = 65536;
+  } else if (kind == RequestKind::MissingSelector) {
+    request.capture.selector = "#soak-no-such-element";
+  }
+  return request;
+}
+
+// Returns false if the outcome was not the expected one.
+static bool RunOne(const BenchCase& bench_case, RequestKind kind) {
+  RenderRequest request = MakeRequest(bench_case, kind);
+  try {
+    if (kind == RequestKind::Streamed) {
+      size_t bytes = 0;
+      StreamRenderRequest(request, [&](const uint8_t*, size_t size) { bytes += size; });
+      return bytes > 0;
+    }
+    RenderResponse response = ProcessRenderRequest(request);
+    if (kind != RequestKind::Buffered) {
+      std::cerr << "> " << bench_case.name << ": expected failure rendered" << std::endl;
+      return false;
+    }
+    return response.png != nullptr;
+  } catch (const std::exception& e) {
+    if (kind == RequestKind::Buffered || kind == RequestKind::Streamed) {
+      std::cerr << "> " << bench_case.name << ": " << e.what() << std::endl;
+      return false;
+    }
+    return true;
+  }
+}
+
+static Sample TakeSample(double seconds, uint64_t renders) {
+  // The engine and malloc gauges are normally refreshed when the render
+  // queue drains, which it does not during a soak.
+  RenderThread::instance().Post([](MyApp& app) {
+    app.SampleEngineMemory();
+    EngineHeap::SampleFragmentation(std::numeric_limits<uint64_t>::max());
+  }).get();
+
+  Metrics& metrics = Metrics::instance();
+  Sample sample;
+  sample.seconds = seconds;
+  sample.renders = renders;
+  sample.rss_bytes = MemoryGovernor::ReadRss();
+  sample.engine_memory_bytes = metrics.engine_memory_bytes.load(std::memory_order_relaxed);
+  sample.engine_heap_live_bytes = EngineHeap::live_bytes();
+  sample.malloc_arena_bytes = metrics.malloc_arena_bytes.load(std::memory_order_relaxed);
+  sample.malloc_free_bytes = metrics.malloc_free_bytes.load(std::memory_order_relaxed);
+  return sample;
+}
+
+// Least-squares slope of `value` over renders, in bytes per render.
+static Fit FitSlope(const std::vector<Sample>& samples, uint64_t warmup_renders,
+                    uint64_t Sample::*value) {
+  Fit fit;
+  double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+  for (const Sample& s : samples) {
+    if (s.renders < warmup_renders)
+      continue;
+    double x = (double)s.renders, y = (double)(s.*value);
+    sum_x += x;
+    sum_y += y;
+    sum_xx += x * x;
+    sum_xy += x * y;
+    fit.samples++;
+  }
+  double n = (double)fit.samples;
+  double denominator = n * sum_xx - sum_x * sum_x;
+  if (fit.samples >= 3 && denominator > 0)
+    fit.slope = (n * sum_xy - sum_x * sum_y) / denominator;
+  return fit;
+}
+
+// Mean throughput of the last quarter of the fitted samples relative to the
+// first quarter, in percent. Negative means the service slowed down.
+static double ThroughputDrift(const std::vector<Sample>& samples, uint64_t warmup_renders) {
+  std::vector<double> rps;
+  for (const Sample& s : samples) {
+    if (s.renders >= warmup_renders && s.throughput_rps > 0)
+      rps.push_back(s.throughput_rps);
+  }
+  size_t quarter = rps.size() / 4;
+  if (!quarter)
+    return 0;
+
+  double first = 0, last = 0;
+  for (size_t i = 0; i < quarter; i++) {
+    first += rps[i];
+    last += rps[rps.size() - 1 - i];
+  }
+  return first > 0 ? (last - first) / first * 100.0 : 0;
+}
+
+static double MiB(uint64_t bytes) {
+  return bytes / (1024.0 * 1024.0);
+}
+
+static void PrintSample(FILE* out, const Sample& s) {
+  fprintf(out, "[%7.0fs] renders %10llu  rps %7.2f  rss %8.1f MiB  engine %8.1f MiB  "
+               "heap %8.1f MiB  arena %8.1f MiB  free %8.1f MiB\n",
+          s.seconds, (unsigned long long)s.renders, s.throughput_rps, MiB(s.rss_bytes),
+          MiB(s.engine_memory_bytes), MiB(s.engine_heap_live_bytes), MiB(s.malloc_arena_bytes),
+          MiB(s.malloc_free_bytes));
+  fflush(out);
+}
+
+struct Report {
+  uint64_t renders = 0;
+  uint64_t unexpected = 0;
+  double wall_seconds = 0;
+  Fit rss, engine, heap, arena;
+  double drift_percent = 0;
+};
+
+static std::string ToJson(const Report& report, const std::vector<Sample>& samples,
+                          const SoakOptions& options) {
+  auto fit = [](const Fit& f) {
+    std::ostringstream out;
+    out << "{ \"samples\": " << f.samples << ", \"bytes_per_render\": " << f.slope << " }";
+    return out.str();
+  };
+
+  std::ostringstream out;
+  out << "{\n  \"label\": \"" << JsonEscape(options.label) << "\",\n"
+      << "  \"timestamp\": " << (long long)time(nullptr) << ",\n"
+      << "  \"concurrency\": " << options.concurrency << ",\n"
+      << "  \"renders\": " << report.renders << ",\n"
+      << "  \"unexpected_results\": " << report.unexpected << ",\n"
+      << "  \"wall_seconds\": " << report.wall_seconds << ",\n"
+      << "  \"warmup_renders\": " << options.warmup_renders << ",\n"
+      << "  \"max_bytes_per_render\": " << options.max_bytes_per_render << ",\n"
+      << "  \"slopes\": {\n"
+      << "    \"rss\": " << fit(report.rss) << ",\n"
+      << "    \"engine_memory\": " << fit(report.engine) << ",\n"
+      << "    \"engine_heap_live\": " << fit(report.heap) << ",\n"
+      << "    \"malloc_arena\": " << fit(report.arena) << "\n  },\n"
+      << "  \"throughput_drift_percent\": " << report.drift_percent << ",\n"
+      << "  \"samples\": [";
+
+  for (size_t i = 0; i < samples.size(); i++) {
+    const Sample& s = samples[i];
+    out << (i ? "," : "") << "\n    { \"seconds\": " << s.seconds << ", \"renders\": " << s.renders
+        << ", \"throughput_rps\": " << s.throughput_rps << ", \"rss_bytes\": " << s.rss_bytes
+        << ", \"engine_memory_bytes\": " << s.engine_memory_bytes
+        << ", \"engine_heap_live_bytes\": " << s.engine_heap_live_bytes
+        << ", \"malloc_arena_bytes\": " << s.malloc_arena_bytes
+        << ", \"malloc_free_bytes\": " << s.malloc_free_bytes << " }";
+  }
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+static bool ParseArgs(int argc, char** argv, SoakOptions* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::cerr << "> Missing value for " << arg << std::endl;
+      return false;
+    }
+    const char* value = argv[++i];
+    if (arg == "--corpus")
+      options->corpus = value;
+    else if (arg == "--duration")
+      options->duration_seconds = strtod(value, nullptr);
+    else if (arg == "--renders")
+      options->renders = strtoull(value, nullptr, 10);
+    else if (arg == "--concurrency")
+      options->concurrency = strtoul(value, nullptr, 10);
+    else if (arg == "--sample-every")
+      options->sample_seconds = strtod(value, nullptr);
+    else if (arg == "--warmup-renders")
+      options->warmup_renders = strtoull(value, nullptr, 10);
+    else if (arg == "--max-bytes-per-render")
+      options->max_bytes_per_render = strtod(value, nullptr);
+    else if (arg == "--stream-every")
+      options->stream_every = strtoul(value, nullptr, 10);
+    else if (arg == "--fail-every")
+      options->fail_every = strtoul(value, nullptr, 10);
+    else if (arg == "--filter")
+      options->filter = value;
+    else if (arg == "--json")
+      options->json = value;
+    else if (arg == "--label")
+      options->label = value;
+    else {
+      std::cerr << "> Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options->sample_seconds <= 0) {
+    std::cerr << "> --sample-every must be positive" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  SoakOptions options;
+  if (!ParseArgs(argc, argv, &options))
+    return 2;
+
+  std::vector<BenchCase> cases;
+  if (!LoadCorpus(options.corpus, options.filter, &cases))
+    return 1;
+  if (cases.empty()) {
+    std::cerr << "> No soak cases matched" << std::endl;
+    return 1;
+  }
+
+  AsyncLogger::instance().set_level((int)ultralight::LogLevel::Error);
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+
+  PlatformOptions platform_options;
+  platform_options.memory = MemoryBudget::FromEnvironment();
+  MyApp::set_platform_options(platform_options);
+  RenderThread::instance().Post([](MyApp& app) { app.Warmup(WarmupOptions()); }).get();
+
+  std::atomic<uint64_t> next{0};
+  std::atomic<uint64_t> completed{0};
+  std::atomic<uint64_t> unexpected{0};
+  std::atomic<bool> stop{false};
+
+  std::vector<std::thread> clients;
+  for (uint32_t c = 0; c < std::max<uint32_t>(options.concurrency, 1); c++) {
+    clients.emplace_back([&] {
+      while (!stop) {
+        uint64_t i = next++;
+        if (options.renders && i >= options.renders)
+          break;
+        if (!RunOne(cases[i % cases.size()], KindFor(i, options)))
+          unexpected++;
+        completed++;
+      }
+    });
+  }
+
+  FILE* out = options.json == "-" ? stderr : stdout;
+  std::vector<Sample> samples;
+  auto started = std::chrono::steady_clock::now();
+  auto elapsed = [&] {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  };
+
+  samples.push_back(TakeSample(0, 0));
+  PrintSample(out, samples.back());
+  for (;;) {
+    double next_sample = samples.back().seconds + options.sample_seconds;
+    bool done = false;
+    while (elapsed() < next_sample) {
+      done = g_interrupted || elapsed() >= options.duration_seconds ||
+             (options.renders && completed >= options.renders);
+      if (done)
+        break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (done) {
+      stop = true;
+      for (auto& client : clients)
+        client.join();
+    }
+
+    Sample sample = TakeSample(elapsed(), completed.load());
+    const Sample& previous = samples.back();
+    if (sample.seconds > previous.seconds)
+      sample.throughput_rps = (sample.renders - previous.renders) / (sample.seconds - previous.seconds);
+    samples.push_back(sample);
+    PrintSample(out, sample);
+    if (done)
+      break;
+  }
+
+  Report report;
+  report.renders = completed.load();
+  report.unexpected = unexpected.load();
+  report.wall_seconds = samples.back().seconds;
+  report.rss = FitSlope(samples, options.warmup_renders, &Sample::rss_bytes);
+  report.engine = FitSlope(samples, options.warmup_renders, &Sample::engine_memory_bytes);
+  report.heap = FitSlope(samples, options.warmup_renders, &Sample::engine_heap_live_bytes);
+  report.arena = FitSlope(samples, options.warmup_renders, &Sample::malloc_arena_bytes);
+  report.drift_percent = ThroughputDrift(samples, options.warmup_renders);
+
+  fprintf(out, "\n%llu renders in %.0f s (%.2f rps), %llu unexpected results\n",
+          (unsigned long long)report.renders, report.wall_seconds,
+          report.wall_seconds > 0 ? report.renders / report.wall_seconds : 0.0,
+          (unsigned long long)report.unexpected);
+  fprintf(out, "bytes/render after %llu renders (%zu samples): rss %.1f  engine %.1f  heap %.1f  arena %.1f\n",
+          (unsigned long long)options.warmup_renders, report.rss.samples, report.rss.slope,
+          report.engine.slope, report.heap.slope, report.arena.slope);
+  fprintf(out, "throughput drift: %+.1f%%\n", report.drift_percent);
+
+  if (!options.json.empty()) {
+    std::string json = ToJson(report, samples, options);
+    if (options.json == "-") {
+      fwrite(json.data(), 1, json.size(), stdout);
+    } else {
+      std::ofstream file(options.json);
+      file << json;
+    }
+  }
+
+  if (report.rss.samples < 3)
+    std::cerr << "> Too few samples after warm-up to fit a memory slope" << std::endl;
+  else if (report.rss.slope > options.max_bytes_per_render) {
+    std::cerr << "> RSS grows " << report.rss.slope << " bytes per render, more than "
+              << options.max_bytes_per_render << std::endl;
+    return 1;
+  }
+  return report.unexpected ? 1 : 0;
+}
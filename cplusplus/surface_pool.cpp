@@ -0,0 +1,168 @@
+#include "surface_pool.h"
+#include "metrics.h"
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace ultralight;
+
+// Multiples of a huge page up to 32 MB, then eighths of the next power of
+// two, so a pool of mixed sizes needs few classes and wastes at most 1/8.
+static size_t SizeClass(size_t size) {
+  size_t step = SurfacePool::kHugePage;
+  if (size > 16 * SurfacePool::kHugePage) {
+    size_t power = 16 * SurfacePool::kHugePage;
+    while (power < size)
+      power *= 2;
+    step = power / 8;
+  }
+  return (size + step - 1) / step * step;
+}
+
+static void* MapAligned(size_t capacity) {
+  // Over-map by one huge page, then cut the ends so the start is aligned.
+  size_t length = capacity + SurfacePool::kHugePage;
+  void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED)
+    throw std::bad_alloc();
+
+  uintptr_t start = reinterpret_cast<uintptr_t>(mapping);
+  uintptr_t aligned = (start + SurfacePool::kHugePage - 1) & ~(uintptr_t)(SurfacePool::kHugePage - 1);
+  if (aligned > start)
+    munmap(mapping, aligned - start);
+  size_t tail = length - (aligned - start) - capacity;
+  if (tail)
+    munmap(reinterpret_cast<void*>(aligned + capacity), tail);
+
+  void* pixels = reinterpret_cast<void*>(aligned);
+  madvise(pixels, capacity, MADV_HUGEPAGE);
+
+  // Fault everything in now rather than during the first paint.
+  long page = sysconf(_SC_PAGESIZE);
+  volatile uint8_t* bytes = static_cast<uint8_t*>(pixels);
+  for (size_t offset = 0; offset < capacity; offset += (size_t)page)
+    bytes[offset] = 0;
+  return pixels;
+}
+
+class PooledSurface : public Surface {
+public:
+  PooledSurface(SurfacePool& pool, uint32_t width, uint32_t height) : pool_(pool) {
+    Resize(width, height);
+  }
+
+  ~PooledSurface() override {
+    if (pixels_)
+      pool_.Release(pixels_, capacity_);
+  }
+
+  uint32_t width() const override { return width_; }
+  uint32_t height() const override { return height_; }
+  uint32_t row_bytes() const override { return row_bytes_; }
+  size_t size() const override { return (size_t)row_bytes_ * height_; }
+  void* LockPixels() override { return pixels_; }
+  void UnlockPixels() override {}
+
+  void Resize(uint32_t width, uint32_t height) override {
+    if (pixels_ && width == width_ && height == height_)
+      return;
+
+    width_ = width;
+    height_ = height;
+    row_bytes_ = (width * 4 + SurfacePool::kRowAlignment - 1) & ~(SurfacePool::kRowAlignment - 1);
+    size_t needed = size();
+
+    // Keep the mapping unless it is too small or now mostly unused.
+    if (pixels_ && (needed > capacity_ || needed < capacity_ / 2)) {
+      pool_.Release(pixels_, capacity_);
+      pixels_ = nullptr;
+      capacity_ = 0;
+    }
+    if (!pixels_ && needed)
+      pixels_ = pool_.Acquire(needed, &capacity_);
+    else if (pixels_)
+      memset(pixels_, 0, needed);
+
+    set_dirty_bounds(IntRect{ 0, 0, (int)width, (int)height });
+  }
+
+private:
+  SurfacePool& pool_;
+  void* pixels_ = nullptr;
+  size_t capacity_ = 0;
+  uint32_t width_ = 0;
+  uint32_t height_ = 0;
+  uint32_t row_bytes_ = 0;
+};
+
+SurfacePool& SurfacePool::instance() {
+  static SurfacePool pool;
+  return pool;
+}
+
+Surface* SurfacePool::CreateSurface(uint32_t width, uint32_t height) {
+  return new PooledSurface(*this, width, height);
+}
+
+void SurfacePool::DestroySurface(Surface* surface) {
+  delete static_cast<PooledSurface*>(surface);
+}
+
+void* SurfacePool::Acquire(size_t size, size_t* capacity) {
+  *capacity = SizeClass(size);
+  Metrics& metrics = Metrics::instance();
+  void* pixels = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = idle_.find(*capacity);
+    if (it != idle_.end()) {
+      pixels = it->second;
+      idle_.erase(it);
+      idle_bytes_ -= *capacity;
+      metrics.surface_pool_idle_bytes.store(idle_bytes_, std::memory_order_relaxed);
+    }
+  }
+  if (!pixels) {
+    metrics.surface_pool_misses.fetch_add(1, std::memory_order_relaxed);
+    return MapAligned(*capacity);
+  }
+
+  // Stale pixels from another render must not show through.
+  metrics.surface_pool_hits.fetch_add(1, std::memory_order_relaxed);
+  memset(pixels, 0, size);
+  return pixels;
+}
+
+void SurfacePool::Release(void* pixels, size_t capacity) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  idle_.emplace(capacity, pixels);
+  idle_bytes_ += capacity;
+  TrimLocked(max_idle_bytes_);
+}
+
+void SurfacePool::set_max_idle_bytes(size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_idle_bytes_ = bytes;
+  TrimLocked(max_idle_bytes_);
+}
+
+size_t SurfacePool::idle_bytes() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return idle_bytes_;
+}
+
+void SurfacePool::ReleaseIdle() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  TrimLocked(0);
+}
+
+void SurfacePool::TrimLocked(size_t max_bytes) {
+  while (idle_bytes_ > max_bytes && !idle_.empty()) {
+    auto largest = std::prev(idle_.end());
+    munmap(largest->second, largest->first);
+    idle_bytes_ -= largest->first;
+    idle_.erase(largest);
+  }
+  Metrics::instance().surface_pool_idle_bytes.store(idle_bytes_, std::memory_order_relaxed);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <Ultralight/platform/Surface.h>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+// The engine's SurfaceFactory. Surface pixels come from 2 MB-aligned
+// anonymous mappings advised for transparent huge pages and faulted in when
+// first mapped. When a view is resized or destroyed its mapping goes back to
+// an idle list keyed by size class instead of being unmapped, so steady-state
+// renders neither allocate nor page-fault their surfaces. Rows are padded to
+// kRowAlignment bytes. Captures read the pixels in place through SurfaceLock.
+class SurfacePool : public ultralight::SurfaceFactory {
+public:
+  static const uint32_t kRowAlignment = 64;
+  static const size_t kHugePage = 2u << 20;
+
+  static SurfacePool& instance();
+
+  ultralight::Surface* CreateSurface(uint32_t width, uint32_t height) override;
+  void DestroySurface(ultralight::Surface* surface) override;
+
+  // Returns a zeroed mapping of at least `size` bytes and stores its size
+  // class in `capacity`.
+  void* Acquire(size_t size, size_t* capacity);
+  void Release(void* pixels, size_t capacity);
+
+  // Idle mappings beyond this many bytes are unmapped, largest first.
+  void set_max_idle_bytes(size_t bytes);
+
+  size_t idle_bytes();
+  // Unmaps every idle mapping now.
+  void ReleaseIdle();
+
+private:
+  SurfacePool() = default;
+
+  void TrimLocked(size_t max_bytes);
+
+  std::mutex mutex_;
+  std::multimap<size_t, void*> idle_;
+  size_t idle_bytes_ = 0;
+  size_t max_idle_bytes_ = 256u << 20;
+};
+
+// Keeps a surface's pixels locked while in scope.
+class SurfaceLock {
+public:
+  explicit SurfaceLock(ultralight::Surface* surface)
+      : surface_(surface), pixels_(static_cast<const uint8_t*>(surface->LockPixels())) {}
+  ~SurfaceLock() { surface_->UnlockPixels(); }
+
+  SurfaceLock(const SurfaceLock&) = delete;
+  SurfaceLock& operator=(const SurfaceLock&) = delete;
+
+  const uint8_t* data() const { return pixels_; }
+  uint32_t row_bytes() const { return surface_->row_bytes(); }
+
+  // First byte of pixel (x, y).
+  const uint8_t* at(uint32_t x, uint32_t y) const {
+    return pixels_ + (size_t)y * surface_->row_bytes() + (size_t)x * 4;
+  }
+
+private:
+  ultralight::Surface* surface_;
+  const uint8_t* pixels_;
+};
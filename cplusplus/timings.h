@@ -0,0 +1,50 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Monotonic timestamps for each phase of a single render. Stamping costs one
+// steady_clock read per phase, so it is always collected; callers decide
+// whether to return it.
+struct RenderTimings {
+  typedef std::chrono::steady_clock Clock;
+
+  Clock::time_point enqueued;
+  Clock::time_point started;
+  Clock::time_point load_begin;
+  Clock::time_point dom_ready;
+  Clock::time_point load_end;
+  Clock::time_point resize_begin;
+  Clock::time_point resize_end;
+  Clock::time_point paint_begin;
+  Clock::time_point paint_end;
+  Clock::time_point encode_begin;
+  Clock::time_point encode_end;
+  Clock::time_point copy_begin;
+  Clock::time_point copy_end;
+
+  uint32_t update_iterations = 0;
+  uint64_t pixels = 0;
+  size_t bytes_in = 0;
+  size_t bytes_out = 0;
+
+  // Engine heap bytes allocated during the job, and the largest live heap
+  // seen in each phase. Zero unless EngineHeap is installed.
+  uint64_t heap_allocated_bytes = 0;
+  uint64_t heap_peak_load = 0;
+  uint64_t heap_peak_paint = 0;
+  uint64_t heap_peak_encode = 0;
+
+  // Milliseconds from `enqueued` to `point`, or -1 if the phase never ran.
+  double SinceEnqueued(Clock::time_point point) const {
+    if (point == Clock::time_point())
+      return -1.0;
+    return std::chrono::duration<double, std::milli>(point - enqueued).count();
+  }
+
+  static double Between(Clock::time_point begin, Clock::time_point end) {
+    if (begin == Clock::time_point() || end == Clock::time_point())
+      return 0.0;
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+  }
+};
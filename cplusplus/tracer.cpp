@@ -0,0 +1,109 @@
+#include "tracer.h"
+#include "async_logger.h"
+#include <cstdio>
+#include <cstring>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+std::atomic<bool> Tracer::enabled_{false};
+
+Tracer& Tracer::instance() {
+  static Tracer tracer;
+  return tracer;
+}
+
+Tracer::ThreadBuffer& Tracer::buffer() {
+  thread_local std::shared_ptr<ThreadBuffer> buffer;
+  if (!buffer) {
+    buffer = std::make_shared<ThreadBuffer>();
+    buffer->tid = syscall(SYS_gettid);
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_.push_back(buffer);
+  }
+  return *buffer;
+}
+
+void Tracer::SetThreadName(const char* name) {
+  ThreadBuffer& buf = buffer();
+  std::lock_guard<std::mutex> lock(buf.mutex);
+  buf.name = name;
+}
+
+void Tracer::AddComplete(const char* name, Clock::time_point begin, Clock::time_point end) {
+  if (!enabled())
+    return;
+
+  ThreadBuffer& buf = buffer();
+  std::lock_guard<std::mutex> lock(buf.mutex);
+  if (buf.events.size() >= kMaxEventsPerThread) {
+    buf.dropped++;
+    return;
+  }
+  buf.events.push_back(Event{name, begin, end, AsyncLogger::context().job});
+}
+
+void Tracer::Start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& buf : buffers_) {
+    std::lock_guard<std::mutex> buffer_lock(buf->mutex);
+    buf->events.clear();
+    buf->dropped = 0;
+  }
+  origin_ = Clock::now();
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+std::string Tracer::Stop() {
+  enabled_.store(false, std::memory_order_relaxed);
+
+  std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  char line[256];
+  long pid = getpid();
+
+  auto append = [&](const char* text) {
+    if (!first)
+      out += ",\n";
+    first = false;
+    out += text;
+  };
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& buf : buffers_) {
+    std::lock_guard<std::mutex> buffer_lock(buf->mutex);
+
+    if (!buf->name.empty()) {
+      snprintf(line, sizeof(line),
+               "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%ld,\"args\":{\"name\":\"%s\"}}",
+               pid, buf->tid, buf->name.c_str());
+      append(line);
+    }
+
+    for (const Event& event : buf->events) {
+      if (event.begin < origin_)
+        continue;
+      double ts = std::chrono::duration<double, std::micro>(event.begin - origin_).count();
+      double dur = std::chrono::duration<double, std::micro>(event.end - event.begin).count();
+      int n = snprintf(line, sizeof(line),
+                       "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f",
+                       event.name, pid, buf->tid, ts, dur);
+      if (event.job && n > 0 && (size_t)n < sizeof(line))
+        snprintf(line + n, sizeof(line) - n, ",\"args\":{\"job\":%llu}", (unsigned long long)event.job);
+      strncat(line, "}", sizeof(line) - strlen(line) - 1);
+      append(line);
+    }
+
+    if (buf->dropped) {
+      snprintf(line, sizeof(line),
+               "{\"name\":\"dropped_events\",\"ph\":\"C\",\"pid\":%ld,\"tid\":%ld,\"ts\":0,\"args\":{\"count\":%llu}}",
+               pid, buf->tid, (unsigned long long)buf->dropped);
+      append(line);
+    }
+
+    buf->events.clear();
+    buf->events.shrink_to_fit();
+  }
+
+  out += "]}\n";
+  return out;
+}
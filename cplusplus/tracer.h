@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Opt-in span recorder that exports Chrome trace_event JSON (viewable in
+// Perfetto or chrome://tracing). Each thread appends to its own buffer, so
+// recording only contends with a concurrent Stop(). While tracing is off a
+// TraceScope costs one relaxed load.
+class Tracer {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  static const size_t kMaxEventsPerThread = 1 << 20;
+
+  static Tracer& instance();
+
+  static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+  // Clears previous events and starts recording.
+  void Start();
+  // Stops recording and returns the trace as JSON.
+  std::string Stop();
+
+  // Names the calling thread in the exported trace.
+  void SetThreadName(const char* name);
+
+  void AddComplete(const char* name, Clock::time_point begin, Clock::time_point end);
+
+private:
+  struct Event {
+    const char* name;
+    Clock::time_point begin;
+    Clock::time_point end;
+    uint64_t job;
+  };
+
+  struct ThreadBuffer {
+    std::mutex mutex;
+    long tid = 0;
+    std::string name;
+    std::vector<Event> events;
+    uint64_t dropped = 0;
+  };
+
+  ThreadBuffer& buffer();
+
+  static std::atomic<bool> enabled_;
+
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+  Clock::time_point origin_;
+};
+
+// Records a complete ("X") event covering the lifetime of the scope.
+class TraceScope {
+public:
+  explicit TraceScope(const char* name) : name_(name) {
+    if (Tracer::enabled())
+      begin_ = Tracer::Clock::now();
+  }
+
+  ~TraceScope() {
+    if (begin_ != Tracer::Clock::time_point())
+      Tracer::instance().AddComplete(name_, begin_, Tracer::Clock::now());
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+  const char* name_;
+  Tracer::Clock::time_point begin_;
+};
@@ -0,0 +1,68 @@
+#include "trim.h"
+#include <algorithm>
+#include <cstring>
+
+static const uint32_t kBlock = 16;
+
+static inline bool IsUniform(const uint32_t* pixels, uint32_t count, uint32_t color) {
+  uint32_t diff = 0;
+  for (uint32_t i = 0; i < count; i++)
+    diff |= pixels[i] ^ color;
+  return diff == 0;
+}
+
+// Index of the first pixel in [0, count) that differs from `color`, or count.
+static uint32_t FirstDifference(const uint32_t* pixels, uint32_t count, uint32_t color) {
+  uint32_t i = 0;
+  for (; i + kBlock <= count && IsUniform(pixels + i, kBlock, color); i += kBlock) {
+  }
+  for (; i < count && pixels[i] == color; i++) {
+  }
+  return i;
+}
+
+// One past the last pixel in [0, count) that differs from `color`, or 0.
+static uint32_t LastDifference(const uint32_t* pixels, uint32_t count, uint32_t color) {
+  uint32_t i = count;
+  for (; i >= kBlock && IsUniform(pixels + i - kBlock, kBlock, color); i -= kBlock) {
+  }
+  for (; i > 0 && pixels[i - 1] == color; i--) {
+  }
+  return i;
+}
+
+void TrimUniformBorders(const uint8_t* pixels, uint32_t row_bytes,
+                        uint32_t* x, uint32_t* y, uint32_t* width, uint32_t* height) {
+  if (!*width || !*height)
+    return;
+
+  auto row = [&](uint32_t index) {
+    return reinterpret_cast<const uint32_t*>(pixels + (size_t)(*y + index) * row_bytes) + *x;
+  };
+  uint32_t color;
+  memcpy(&color, row(0), sizeof(color));
+
+  uint32_t top = 0;
+  while (top < *height && IsUniform(row(top), *width, color))
+    top++;
+  if (top == *height)
+    return;
+
+  uint32_t bottom = *height;
+  while (bottom > top && IsUniform(row(bottom - 1), *width, color))
+    bottom--;
+
+  // Each row only needs to be searched up to the edges found so far.
+  uint32_t left = *width;
+  uint32_t right = 0;
+  for (uint32_t r = top; r < bottom; r++) {
+    const uint32_t* line = row(r);
+    left = std::min(left, FirstDifference(line, left, color));
+    right = std::max(right, right + LastDifference(line + right, *width - right, color));
+  }
+
+  *x += left;
+  *y += top;
+  *width = right - left;
+  *height = bottom - top;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+
+// Shrinks the area x, y, width, height of a BGRA image to the bounding box of
+// everything that differs from the area's top-left pixel, so uniform borders
+// are not encoded. Rows and row segments are compared as whole 32-bit pixels
+// in blocks the compiler vectorizes. Leaves the area unchanged if it is
+// entirely uniform.
+void TrimUniformBorders(const uint8_t* pixels, uint32_t row_bytes,
+                        uint32_t* x, uint32_t* y, uint32_t* width, uint32_t* height);
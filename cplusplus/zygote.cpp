@@ -0,0 +1,463 @@
+// Pre-forking render server. The parent maps the engine resources and the
+// warm-up fonts, binds the socket and then forks workers that inherit those
+// pages copy-on-write. The Renderer itself spawns threads and is therefore
+// created in each worker after fork().
+//
+// Wire format (all integers uint32 little-endian), one or more requests per
+// connection:
+//   request:  width, height, html_len, image_count, option_count, html,
+//             image_count x (name_len, name, path_len, path),
+//             option_count x (key_len, key, value_len, value)
+//   response: status (0 = ok), payload_len, payload (PNG or error message),
+//             meta_len, meta ("key=value" lines: crop and the phase timings)
+//
+// Options are the addon's render options as strings, e.g. "scale" = "2",
+// "fullPage" = "1", "view.userAgent" = "..." or "network.hosts" =
+// "a.example,b.example". Output sizes and viewports, which return several
+// PNGs, are not supported.
+//
+// The first worker to finish warming up creates <socket>.ready, which the
+// service uses as its health check. The zygote removes it on exit.
+
+#include "async_logger.h"
+#include "preload.h"
+#include "render_service.h"
+#include "render_thread.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <set>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace ultralight;
+
+static const uint32_t kMaxFieldSize = 64 * 1024 * 1024;
+
+static volatile sig_atomic_t g_stop = 0;
+static volatile sig_atomic_t g_scale = 0;
+
+static void HandleSignal(int signal) {
+  if (signal == SIGTTIN)
+    g_scale = g_scale + 1;
+  else if (signal == SIGTTOU)
+    g_scale = g_scale - 1;
+  else
+    g_stop = 1;
+}
+
+static bool ReadFully(int fd, void* data, size_t size) {
+  uint8_t* out = static_cast<uint8_t*>(data);
+  while (size > 0) {
+    ssize_t n = read(fd, out, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    out += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool WriteFully(int fd, const void* data, size_t size) {
+  const uint8_t* in = static_cast<const uint8_t*>(data);
+  while (size > 0) {
+    ssize_t n = write(fd, in, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    in += n;
+    size -= n;
+  }
+  return true;
+}
+
+static bool ReadU32(int fd, uint32_t& value) {
+  uint8_t bytes[4];
+  if (!ReadFully(fd, bytes, sizeof(bytes)))
+    return false;
+  value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+  return true;
+}
+
+static bool WriteU32(int fd, uint32_t value) {
+  uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16),
+                       (uint8_t)(value >> 24) };
+  return WriteFully(fd, bytes, sizeof(bytes));
+}
+
+static bool ReadString(int fd, uint32_t length, std::string& out) {
+  if (length > kMaxFieldSize)
+    return false;
+  out.resize(length);
+  return length == 0 || ReadFully(fd, &out[0], length);
+}
+
+static bool ReadSizedString(int fd, std::string& out) {
+  uint32_t length;
+  return ReadU32(fd, length) && ReadString(fd, length, out);
+}
+
+static bool ParseFlag(const std::string& value) {
+  return value == "1" || value == "true";
+}
+
+// Applies one render option. Returns false with `error` set for unknown keys
+// and out-of-range values, with the same limits as the addon.
+static bool ApplyOption(const std::string& key, const std::string& value, RenderRequest& request,
+                        std::string& error) {
+  CaptureOptions& capture = request.capture;
+  ViewProfile& profile = request.profile;
+  if (key == "scale") {
+    capture.scale = strtod(value.c_str(), nullptr);
+    if (!(capture.scale >= 0.25 && capture.scale <= 4.0)) {
+      error = "scale must be a number between 0.25 and 4";
+      return false;
+    }
+  } else if (key == "fullPage") {
+    capture.full_page = ParseFlag(value);
+  } else if (key == "tileHeight") {
+    char* end = nullptr;
+    double number = strtod(value.c_str(), &end);
+    if (end == value.c_str() || *end || !(number >= 1) || number != std::floor(number)) {
+      error = "tileHeight must be a positive integer";
+      return false;
+    }
+    capture.tile_height = (uint32_t)std::clamp(number, (double)kMinTileHeight, (double)UINT32_MAX);
+  } else if (key == "selector") {
+    capture.selector = value;
+  } else if (key == "trim") {
+    capture.trim = ParseFlag(value);
+  } else if (key == "animationDurationMs" || key == "animationFps") {
+    unsigned long number = strtoul(value.c_str(), nullptr, 10);
+    bool duration = key == "animationDurationMs";
+    if (number < 1 || number > (duration ? 60000ul : 60ul)) {
+      error = "animation must be { durationMs, fps? } with durationMs up to 60000 and fps from 1 to 60";
+      return false;
+    }
+    (duration ? capture.animation_duration_ms : capture.animation_fps) = (uint32_t)number;
+  } else if (key == "staticFastPath") {
+    request.static_fast_path = ParseFlag(value);
+  } else if (key == "view.javascript") {
+    profile.enable_javascript = ParseFlag(value);
+  } else if (key == "view.images") {
+    profile.enable_images = ParseFlag(value);
+  } else if (key == "view.transparent") {
+    profile.is_transparent = ParseFlag(value);
+  } else if (key == "view.fontFamily") {
+    profile.font_family_standard = value;
+  } else if (key == "view.fixedFontFamily") {
+    profile.font_family_fixed = value;
+  } else if (key == "view.serifFontFamily") {
+    profile.font_family_serif = value;
+  } else if (key == "view.sansSerifFontFamily") {
+    profile.font_family_sans_serif = value;
+  } else if (key == "view.userAgent") {
+    profile.user_agent = value;
+  } else if (key == "network.hosts") {
+    // Comma separated. Like a hosts array, implies "allowlist" unless a
+    // later network.mode says otherwise.
+    NetworkPolicy::ParseHosts(value, &request.network.hosts);
+    request.network.mode = NetworkPolicy::Mode::AllowList;
+  } else if (key == "network.mode") {
+    if (!NetworkPolicy::ParseMode(value, &request.network.mode)) {
+      error = "network.mode must be \"allow\", \"block\" or \"allowlist\"";
+      return false;
+    }
+  } else if (key == "network.remoteBudgetMs") {
+    unsigned long budget = strtoul(value.c_str(), nullptr, 10);
+    if (budget > 600000ul) {
+      error = "network.remoteBudgetMs must be at most 600000";
+      return false;
+    }
+    request.network.remote_budget_ms = (uint32_t)budget;
+  } else {
+    error = "Unsupported option in zygote mode: " + key;
+    return false;
+  }
+  return true;
+}
+
+static void AppendMeta(std::string& meta, const char* key, double value) {
+  char line[96];
+  snprintf(line, sizeof(line), "%s=%.3f\n", key, value);
+  meta += line;
+}
+
+// The same phase breakdown the addon returns as `timings`. There is no copy
+// into a Node Buffer here, so total ends with the encode.
+static std::string ResponseMeta(const RenderResponse& response) {
+  const RenderTimings& t = response.timings;
+  std::string meta;
+  AppendMeta(meta, "queueMs", RenderTimings::Between(t.enqueued, t.started));
+  AppendMeta(meta, "parseMs", RenderTimings::Between(t.load_begin, t.dom_ready));
+  AppendMeta(meta, "resourcesMs", RenderTimings::Between(t.dom_ready, t.load_end));
+  AppendMeta(meta, "resizeMs", RenderTimings::Between(t.resize_begin, t.resize_end));
+  AppendMeta(meta, "paintMs", RenderTimings::Between(t.paint_begin, t.paint_end));
+  AppendMeta(meta, "encodeMs", RenderTimings::Between(t.encode_begin, t.encode_end));
+  AppendMeta(meta, "copyMs", 0.0);
+  AppendMeta(meta, "totalMs", RenderTimings::Between(t.enqueued, t.encode_end));
+  if (response.trimmed) {
+    meta += "crop=" + std::to_string(response.crop.x) + "," + std::to_string(response.crop.y) + "," +
+            std::to_string(response.crop.width) + "," + std::to_string(response.crop.height) + "\n";
+  }
+  return meta;
+}
+
+static void ServeConnection(int fd) {
+  for (;;) {
+    uint32_t width, height, html_len, image_count, option_count;
+    if (!ReadU32(fd, width) || !ReadU32(fd, height) || !ReadU32(fd, html_len) ||
+        !ReadU32(fd, image_count) || !ReadU32(fd, option_count))
+      return;
+
+    std::string html;
+    if (!ReadString(fd, html_len, html))
+      return;
+
+    std::map<std::string, std::string> imagePaths;
+    for (uint32_t i = 0; i < image_count; i++) {
+      std::string name, path;
+      if (!ReadSizedString(fd, name) || !ReadSizedString(fd, path))
+        return;
+      imagePaths[name] = path;
+    }
+
+    RenderRequest request;
+    request.html = std::move(html);
+    request.width = width;
+    request.height = height;
+    request.with_images = !imagePaths.empty();
+    request.imagePaths = std::move(imagePaths);
+
+    // Options are read in full even after a bad one, so the connection
+    // stays in sync for the next request.
+    std::string error;
+    for (uint32_t i = 0; i < option_count; i++) {
+      std::string key, value;
+      if (!ReadSizedString(fd, key) || !ReadSizedString(fd, value))
+        return;
+      if (error.empty())
+        ApplyOption(key, value, request, error);
+    }
+    if (error.empty()) {
+      if (const char* capture_error = CaptureOptionsError(request.capture, false))
+        error = capture_error;
+    }
+
+    RenderResponse response;
+    if (error.empty()) {
+      try {
+        response = ProcessRenderRequest(request);
+      } catch (const std::exception& e) {
+        error = e.what();
+      }
+    }
+
+    bool ok;
+    std::string meta;
+    if (response.png) {
+      meta = ResponseMeta(response);
+      ok = WriteU32(fd, 0) && WriteU32(fd, (uint32_t)response.png->size()) &&
+           WriteFully(fd, response.png->data(), response.png->size());
+    } else {
+      if (error.empty())
+        error = "Failed to render HTML";
+      ok = WriteU32(fd, 1) && WriteU32(fd, (uint32_t)error.size()) &&
+           WriteFully(fd, error.data(), error.size());
+    }
+    ok = ok && WriteU32(fd, (uint32_t)meta.size()) && WriteFully(fd, meta.data(), meta.size());
+    if (!ok)
+      return;
+  }
+}
+
+static void RunWorker(int listen_fd, int ready_fd, const WarmupOptions& warmup) {
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTTIN, SIG_DFL);
+  signal(SIGTTOU, SIG_DFL);
+
+  // The logger's drain thread is started here, after the fork; a thread
+  // started in the zygote would not exist in its children.
+  int level;
+  const char* level_env = getenv("LOG_LEVEL");
+  if (level_env && AsyncLogger::ParseLevel(level_env, &level))
+    AsyncLogger::instance().set_level(level);
+
+  auto started = std::chrono::steady_clock::now();
+  RenderThread::instance().Post([&](MyApp& app) { app.Warmup(warmup); }).get();
+  RenderThread::instance().set_ready(true);
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - started);
+  std::cout << "> Worker " << getpid() << " ready in " << elapsed.count() << " ms" << std::endl;
+
+  char ready = 1;
+  if (write(ready_fd, &ready, 1) != 1)
+    std::cerr << "> Worker " << getpid() << " could not signal readiness" << std::endl;
+  close(ready_fd);
+
+  for (;;) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      break;
+    }
+    ServeConnection(fd);
+    close(fd);
+  }
+}
+
+static pid_t SpawnWorker(int listen_fd, const int ready_pipe[2], const WarmupOptions& warmup) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(ready_pipe[0]);
+    RunWorker(listen_fd, ready_pipe[1], warmup);
+    _exit(0);
+  }
+  if (pid < 0)
+    std::cerr << "> fork() failed: " << strerror(errno) << std::endl;
+  return pid;
+}
+
+static std::vector<std::string> SplitList(const char* value) {
+  std::vector<std::string> out;
+  if (!value)
+    return out;
+  std::stringstream ss(value);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty())
+      out.push_back(item);
+  }
+  return out;
+}
+
+int main(int argc, char** argv) {
+  const char* socket_env = getenv("ZYGOTE_SOCKET");
+  std::string socket_path = argc > 1 ? argv[1] : (socket_env ? socket_env : "/tmp/html-to-png.sock");
+
+  const char* workers_env = getenv("ZYGOTE_WORKERS");
+  size_t target = workers_env ? strtoul(workers_env, nullptr, 10) : 0;
+  if (target == 0)
+    target = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+
+  WarmupOptions warmup;
+  warmup.fonts = SplitList(getenv("WARMUP_FONTS"));
+
+  PreloadedFileSystem file_system("./assets/");
+  size_t resource_bytes = file_system.PreloadDirectory("resources");
+
+  PreloadedFontLoader font_loader;
+  size_t font_bytes = 0;
+  for (const auto& family : warmup.fonts)
+    font_bytes += font_loader.Preload(family);
+
+  std::cout << "> Zygote preloaded " << resource_bytes << " resource bytes and " << font_bytes
+            << " font bytes" << std::endl;
+
+  PlatformOptions platform_options;
+  platform_options.file_system = &file_system;
+  platform_options.font_loader = &font_loader;
+  platform_options.memory = MemoryBudget::FromEnvironment();
+  // No RENDER_HTTP_CACHE_DIR: forked workers would share one engine cache
+  // directory without coordinating writes.
+  platform_options.network = NetworkPolicy::FromEnvironment();
+  MyApp::set_platform_options(platform_options);
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (listen_fd < 0 || socket_path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "> Invalid socket path: " << socket_path << std::endl;
+    return 1;
+  }
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  unlink(socket_path.c_str());
+  std::string ready_path = socket_path + ".ready";
+  unlink(ready_path.c_str());
+  if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 128) != 0) {
+    std::cerr << "> Failed to listen on " << socket_path << ": " << strerror(errno) << std::endl;
+    return 1;
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = HandleSignal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGTERM, &action, nullptr);
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTTIN, &action, nullptr);
+  sigaction(SIGTTOU, &action, nullptr);
+
+  // Workers write a byte here once warmed up.
+  int ready_pipe[2];
+  if (pipe2(ready_pipe, O_CLOEXEC) != 0) {
+    std::cerr << "> pipe2() failed: " << strerror(errno) << std::endl;
+    return 1;
+  }
+  bool ready = false;
+
+  std::set<pid_t> workers;
+  while (!g_stop) {
+    if (g_scale != 0) {
+      long scale = g_scale;
+      g_scale = 0;
+      target = (size_t)std::max(1L, (long)target + scale);
+    }
+
+    while (workers.size() < target) {
+      pid_t pid = SpawnWorker(listen_fd, ready_pipe, warmup);
+      if (pid < 0)
+        break;
+      workers.insert(pid);
+    }
+    while (workers.size() > target) {
+      kill(*workers.begin(), SIGTERM);
+      workers.erase(workers.begin());
+    }
+
+    // Signals interrupt the poll, so scaling and shutdown stay prompt.
+    pollfd ready_poll = { ready_pipe[0], POLLIN, 0 };
+    if (poll(&ready_poll, 1, 1000) > 0 && (ready_poll.revents & POLLIN)) {
+      char bytes[64];
+      if (read(ready_pipe[0], bytes, sizeof(bytes)) > 0 && !ready) {
+        int fd = open(ready_path.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+          close(fd);
+          ready = true;
+          std::cout << "> Zygote ready" << std::endl;
+        }
+      }
+    }
+
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+      if (workers.erase(pid) && !g_stop)
+        std::cerr << "> Worker " << pid << " exited, respawning" << std::endl;
+    }
+  }
+
+  for (pid_t pid : workers)
+    kill(pid, SIGTERM);
+  while (waitpid(-1, nullptr, 0) > 0) {}
+
+  close(listen_fd);
+  unlink(ready_path.c_str());
+  unlink(socket_path.c_str());
+  return 0;
+}
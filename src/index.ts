@@ -2,10 +2,279 @@ import express, { Request, Response } from "express";
 import multer from "multer";
 import path from "path";
 import fs from "fs";
+import { Readable } from "stream";
+import { isZygoteReady, renderViaZygote, ZygoteUnsupportedError } from "./zygote";
+
+const zygoteSocket = process.env.ZYGOTE_SOCKET;
+const addon = zygoteSocket ? null : require("../build/Release/addon");
 
 const app = express();
 const PORT = process.env.PORT || 3000;
 
+const warmupFonts = (process.env.WARMUP_FONTS || "")
+  .split(",")
+  .map((font) => font.trim())
+  .filter((font) => font.length > 0);
+
+if (addon) {
+  if (process.env.LOG_LEVEL) {
+    addon.setLogLevel(process.env.LOG_LEVEL);
+  }
+
+  addon.configureCache({
+    maxBytes: parseInt(process.env.RENDER_CACHE_BYTES || String(64 * 1024 * 1024)),
+    diskPath: process.env.RENDER_CACHE_DIR,
+    ttlMs: parseInt(process.env.RENDER_CACHE_TTL_MS || "60000"),
+  });
+
+  addon
+    .init({
+      fonts: warmupFonts,
+      views: parseInt(process.env.WARMUP_VIEWS || "1"),
+      loadTimeoutMs: parseInt(process.env.RENDER_LOAD_TIMEOUT_MS || "30000"),
+      maxFullPageHeight: parseInt(process.env.MAX_FULL_PAGE_HEIGHT || "16384"),
+      surfacePoolBytes: parseInt(process.env.SURFACE_POOL_BYTES || String(256 * 1024 * 1024)),
+    })
+    .then(() => {
+      console.log("Renderer is warmed up and ready");
+    })
+    .catch((error: unknown) => {
+      console.error("Renderer ısınma hatası:", error);
+    });
+}
+
+interface RenderResult {
+  png: Buffer;
+  pngs?: Buffer[];
+  crop?: { x: number; y: number; width: number; height: number };
+  timings?: { [key: string]: number | string };
+}
+
+interface ViewOptions {
+  javascript?: boolean;
+  images?: boolean;
+  transparent?: boolean;
+  fontFamily?: string;
+  fixedFontFamily?: string;
+  serifFontFamily?: string;
+  sansSerifFontFamily?: string;
+  userAgent?: string;
+}
+
+// Multipart bodies carry the view options as a JSON string.
+function parseViewOptions(value: unknown): ViewOptions | undefined {
+  if (typeof value === "string") {
+    try {
+      return JSON.parse(value);
+    } catch {
+      return undefined;
+    }
+  }
+  return value && typeof value === "object" ? (value as ViewOptions) : undefined;
+}
+
+interface Dimensions {
+  width: number;
+  height?: number;
+}
+
+// Multipart bodies carry sizes and viewports as JSON strings.
+function parseDimensions(value: unknown): Dimensions[] | undefined {
+  if (typeof value === "string") {
+    try {
+      value = JSON.parse(value);
+    } catch {
+      return undefined;
+    }
+  }
+  return Array.isArray(value) ? (value as Dimensions[]) : undefined;
+}
+
+interface AnimationOptions {
+  durationMs: number;
+  fps?: number;
+}
+
+// Multipart bodies carry the animation as a JSON string.
+function parseAnimation(value: unknown): AnimationOptions | undefined {
+  if (typeof value === "string") {
+    try {
+      value = JSON.parse(value);
+    } catch {
+      return undefined;
+    }
+  }
+  return value && typeof value === "object" ? (value as AnimationOptions) : undefined;
+}
+
+interface NetworkOptions {
+  mode?: "allow" | "block" | "allowlist";
+  hosts?: string[];
+  remoteBudgetMs?: number;
+}
+
+// Multipart bodies carry the network policy as a JSON string.
+function parseNetworkOptions(value: unknown): NetworkOptions | undefined {
+  if (typeof value === "string") {
+    try {
+      value = JSON.parse(value);
+    } catch {
+      return undefined;
+    }
+  }
+  return value && typeof value === "object" ? (value as NetworkOptions) : undefined;
+}
+
+interface RenderOptions {
+  view?: ViewOptions;
+  scale?: number;
+  fullPage?: boolean;
+  tileHeight?: number;
+  sizes?: Dimensions[];
+  viewports?: Dimensions[];
+  selector?: string;
+  trim?: boolean;
+  animation?: AnimationOptions;
+  network?: NetworkOptions;
+}
+
+function parseRenderOptions(body: any): RenderOptions {
+  return {
+    view: parseViewOptions(body.view),
+    scale: body.scale !== undefined ? Number(body.scale) : undefined,
+    fullPage: body.fullPage === true || body.fullPage === "true",
+    tileHeight: body.tileHeight !== undefined ? Number(body.tileHeight) : undefined,
+    sizes: parseDimensions(body.sizes),
+    viewports: parseDimensions(body.viewports),
+    selector: typeof body.selector === "string" && body.selector ? body.selector : undefined,
+    trim: body.trim === true || body.trim === "true",
+    animation: parseAnimation(body.animation),
+    network: parseNetworkOptions(body.network),
+  };
+}
+
+// Flattens the options into the zygote's string options. Output sizes and
+// viewports return several PNGs, which its wire format cannot carry.
+function zygoteOptions(renderOptions: RenderOptions): { [key: string]: string } {
+  if (renderOptions.sizes || renderOptions.viewports) {
+    throw new ZygoteUnsupportedError("sizes and viewports are not supported in zygote mode");
+  }
+
+  const options: { [key: string]: string } = {};
+  const set = (key: string, value: unknown) => {
+    if (value !== undefined && value !== null) {
+      options[key] = typeof value === "boolean" ? (value ? "1" : "0") : String(value);
+    }
+  };
+  set("scale", renderOptions.scale);
+  set("fullPage", renderOptions.fullPage || undefined);
+  set("tileHeight", renderOptions.tileHeight);
+  set("selector", renderOptions.selector);
+  set("trim", renderOptions.trim || undefined);
+  if (renderOptions.animation) {
+    set("animationDurationMs", renderOptions.animation.durationMs);
+    set("animationFps", renderOptions.animation.fps);
+  }
+  for (const [key, value] of Object.entries(renderOptions.view || {})) {
+    set(`view.${key}`, value);
+  }
+  // The zygote applies options in order, so an explicit mode still wins over
+  // the allowlist that hosts imply.
+  const network = renderOptions.network;
+  if (network) {
+    set("network.hosts", Array.isArray(network.hosts) ? network.hosts.join(",") : network.hosts);
+    set("network.mode", network.mode);
+    set("network.remoteBudgetMs", network.remoteBudgetMs);
+  }
+  return options;
+}
+
+async function renderHtml(
+  html: string,
+  width: number,
+  height: number,
+  imagePaths?: { [key: string]: string },
+  renderOptions: RenderOptions = {}
+): Promise<RenderResult> {
+  if (zygoteSocket) {
+    const { png, meta } = await renderViaZygote(
+      zygoteSocket,
+      html,
+      width,
+      height,
+      imagePaths,
+      zygoteOptions(renderOptions)
+    );
+    const [x, y, cropWidth, cropHeight] = (meta.crop || "").split(",").map(Number);
+    return {
+      png,
+      timings: meta,
+      crop: meta.crop ? { x, y, width: cropWidth, height: cropHeight } : undefined,
+    };
+  }
+  const options = { timings: true, ...renderOptions };
+  if (imagePaths) {
+    return addon.renderHtmlToPNGWithImagesAsync(html, width, height, imagePaths, options);
+  }
+  return addon.renderHtmlToPNGAsync(html, width, height, options);
+}
+
+// Starts a render whose PNG chunks are pushed to the returned stream as the
+// encoder produces them. The stream errors if the render fails part-way.
+function renderHtmlStream(
+  html: string,
+  width: number,
+  height: number,
+  renderOptions: RenderOptions = {}
+): Readable {
+  // Returning false pauses the encoder until read() asks for more. Chunks for
+  // a destroyed stream are dropped so the render can finish.
+  let resume: (() => void) | undefined;
+  const wake = () => {
+    const next = resume;
+    resume = undefined;
+    if (next) {
+      next();
+    }
+  };
+  const stream = new Readable({
+    read: wake,
+    destroy(error, callback) {
+      wake();
+      callback(error);
+    },
+  });
+  addon
+    .renderHtmlToPNGStream(html, width, height, renderOptions, (chunk: Buffer, next: () => void) => {
+      if (stream.destroyed || stream.push(chunk)) {
+        return true;
+      }
+      resume = next;
+      return false;
+    })
+    .then(() => stream.push(null))
+    .catch((error: Error) => stream.destroy(error));
+  return stream;
+}
+
+// Reports the area a trimmed render kept, as x,y,width,height in pixels.
+function setCropHeader(res: Response, crop?: RenderResult["crop"]) {
+  if (crop) {
+    res.setHeader("X-Crop", `${crop.x},${crop.y},${crop.width},${crop.height}`);
+  }
+}
+
+function setServerTiming(res: Response, timings?: RenderResult["timings"]) {
+  if (!timings) {
+    return;
+  }
+  const phases = ["queue", "parse", "resources", "resize", "paint", "encode", "copy", "total"];
+  res.setHeader(
+    "Server-Timing",
+    phases.map((phase) => `${phase};dur=${Number(timings[`${phase}Ms`]).toFixed(2)}`).join(", ")
+  );
+}
+
 const storage = multer.diskStorage({
   destination: function (req, file, cb) {
     const tempDir = path.join(__dirname, "../temp");
@@ -23,19 +292,77 @@ const upload = multer({ storage: storage });
 
 app.use(express.json());
 
-app.post("/api/render-html-to-png", (req: Request, res: Response) => {
+app.get("/health", (req: Request, res: Response) => {
+  const ready = addon ? addon.isReady() : isZygoteReady(zygoteSocket as string);
+  if (ready) {
+    res.json({ status: "ready" });
+  } else {
+    res.status(503).json({ status: "warming-up" });
+  }
+});
+
+app.get("/metrics", (req: Request, res: Response) => {
+  if (!addon) {
+    res.status(501).json({ error: "Metrikler zygote modunda desteklenmiyor" });
+    return;
+  }
+  res.type("text/plain; version=0.0.4").send(addon.getMetrics());
+});
+
+app.get("/debug/trace", async (req: Request, res: Response) => {
+  if (!addon) {
+    res.status(501).json({ error: "İzleme zygote modunda desteklenmiyor" });
+    return;
+  }
+  const seconds = Math.min(Math.max(Number(req.query.seconds) || 5, 1), 60);
+  addon.startTrace();
+  await new Promise((resolve) => setTimeout(resolve, seconds * 1000));
+  res.type("application/json").send(addon.stopTrace());
+});
+
+app.post("/api/render-html-to-png", async (req: Request, res: Response) => {
   const htmlContent = req.body.html;
   const width = req.body.width || 1280;
   const height = req.body.height || 720;
 
+  if (addon && (req.body.stream === true || req.body.stream === "true")) {
+    const stream = renderHtmlStream(htmlContent, width, height, parseRenderOptions(req.body));
+    stream.once("error", (error) => {
+      console.error("Render hatası:", error);
+      if (res.headersSent) {
+        res.destroy(error);
+      } else {
+        res.status(500).json({ error: "HTML'i PNG'ye dönüştürürken hata oluştu" });
+      }
+    });
+    res.setHeader("Content-Type", "image/png");
+    stream.pipe(res);
+    return;
+  }
+
   try {
-    const addon = require("../build/Release/addon");
-    const buffer = addon.renderHtmlToPNG(htmlContent, width, height);
+    const { png: buffer, pngs, timings, crop } = await renderHtml(
+      htmlContent,
+      width,
+      height,
+      undefined,
+      parseRenderOptions(req.body)
+    );
 
+    setServerTiming(res, timings);
+    setCropHeader(res, crop);
+    if (pngs) {
+      res.json({ images: pngs.map((png) => png.toString("base64")) });
+      return;
+    }
     res.setHeader("Content-Type", "image/png");
     res.setHeader("Content-Length", buffer.length);
     res.send(buffer);
   } catch (error) {
+    if (error instanceof ZygoteUnsupportedError) {
+      res.status(501).json({ error: "Bu seçenekler zygote modunda desteklenmiyor" });
+      return;
+    }
     console.error("Render hatası:", error);
     res.status(500).json({ error: "HTML'i PNG'ye dönüştürürken hata oluştu" });
   }
@@ -44,7 +371,7 @@ app.post("/api/render-html-to-png", (req: Request, res: Response) => {
 app.post(
   "/api/render-html-with-images-to-png",
   upload.array("images"),
-  (req: Request, res: Response) => {
+  async (req: Request, res: Response) => {
     const htmlContent = req.body.html;
     const width = parseInt(req.body.width) || 1280;
     const height = parseInt(req.body.height) || 720;
@@ -58,12 +385,12 @@ app.post(
     }
 
     try {
-      const addon = require("../build/Release/addon");
-      const buffer = addon.renderHtmlToPNGWithImages(
+      const { png: buffer, pngs, timings, crop } = await renderHtml(
         htmlContent,
         width,
         height,
-        imagePaths
+        imagePaths,
+        parseRenderOptions(req.body)
       );
 
       if (files && files.length > 0) {
@@ -76,10 +403,20 @@ app.post(
         });
       }
 
+      setServerTiming(res, timings);
+      setCropHeader(res, crop);
+      if (pngs) {
+        res.json({ images: pngs.map((png) => png.toString("base64")) });
+        return;
+      }
       res.setHeader("Content-Type", "image/png");
       res.setHeader("Content-Length", buffer.length);
       res.send(buffer);
     } catch (error) {
+      if (error instanceof ZygoteUnsupportedError) {
+        res.status(501).json({ error: "Bu seçenekler zygote modunda desteklenmiyor" });
+        return;
+      }
       console.error("Render hatası:", error);
       res
         .status(500)
@@ -88,6 +425,101 @@ app.post(
   }
 );
 
+app.post("/api/templates", async (req: Request, res: Response) => {
+  if (!addon) {
+    res.status(501).json({ error: "Şablonlar zygote modunda desteklenmiyor" });
+    return;
+  }
+
+  const { id, html } = req.body;
+  const width = req.body.width || 1280;
+  const height = req.body.height || 720;
+
+  try {
+    await addon.registerTemplate(id, html, width, height, { view: parseViewOptions(req.body.view) });
+    res.status(201).json({ id });
+  } catch (error) {
+    console.error("Şablon kayıt hatası:", error);
+    res.status(500).json({ error: "Şablon kaydedilirken hata oluştu" });
+  }
+});
+
+app.delete("/api/templates/:id", async (req: Request, res: Response) => {
+  if (!addon) {
+    res.status(501).json({ error: "Şablonlar zygote modunda desteklenmiyor" });
+    return;
+  }
+
+  const id = req.params.id as string;
+  try {
+    if (await addon.unregisterTemplate(id)) {
+      res.status(204).end();
+    } else {
+      res.status(404).json({ error: "Şablon bulunamadı" });
+    }
+  } catch (error) {
+    console.error("Şablon silme hatası:", error);
+    res.status(500).json({ error: "Şablon silinirken hata oluştu" });
+  }
+});
+
+app.post("/api/templates/:id/render", async (req: Request, res: Response) => {
+  if (!addon) {
+    res.status(501).json({ error: "Şablonlar zygote modunda desteklenmiyor" });
+    return;
+  }
+
+  try {
+    const buffer = await addon.renderTemplate(
+      req.params.id,
+      req.body.data || {},
+      req.body.width,
+      req.body.height,
+      { scale: parseRenderOptions(req.body).scale }
+    );
+
+    res.setHeader("Content-Type", "image/png");
+    res.setHeader("Content-Length", buffer.length);
+    res.send(buffer);
+  } catch (error) {
+    console.error("Şablon render hatası:", error);
+    res.status(500).json({ error: "Şablon PNG'ye dönüştürülürken hata oluştu" });
+  }
+});
+
+app.post("/api/templates/:id/delta", async (req: Request, res: Response) => {
+  if (!addon) {
+    res.status(501).json({ error: "Şablonlar zygote modunda desteklenmiyor" });
+    return;
+  }
+
+  try {
+    const result = await addon.renderTemplateDelta(
+      req.params.id,
+      req.body.data || {},
+      req.body.width,
+      req.body.height,
+      {
+        scale: parseRenderOptions(req.body).scale,
+        keyframeInterval: req.body.keyframeInterval,
+        keyframe: req.body.keyframe === true,
+        since: req.body.since,
+      }
+    );
+
+    res.json({
+      ...result,
+      patches: result.patches.map((patch: { png: Buffer }) => ({
+        ...patch,
+        png: patch.png.toString("base64"),
+      })),
+    });
+  } catch (error) {
+    console.error("Şablon delta render hatası:", error);
+    res.status(500).json({ error: "Şablon değişiklikleri hesaplanırken hata oluştu" });
+  }
+});
+
 app.listen(PORT, () => {
   console.log(`Server is running on port ${PORT}`);
 });
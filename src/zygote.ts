@@ -0,0 +1,115 @@
+import net from "net";
+import fs from "fs";
+
+export interface ZygoteResult {
+  png: Buffer;
+  // "key=value" lines from the worker: the phase timings and, for trimmed
+  // captures, the crop.
+  meta: { [key: string]: string };
+}
+
+// Thrown for render options the zygote wire format cannot carry.
+export class ZygoteUnsupportedError extends Error {
+  constructor(message: string) {
+    super(message);
+    // Keeps instanceof working when compiled for ES5.
+    Object.setPrototypeOf(this, ZygoteUnsupportedError.prototype);
+  }
+}
+
+// The zygote creates this once its first worker has warmed up.
+export function isZygoteReady(socketPath: string): boolean {
+  return fs.existsSync(`${socketPath}.ready`);
+}
+
+function sizedString(value: string): Buffer[] {
+  const valueBuffer = Buffer.from(value, "utf8");
+  const length = Buffer.alloc(4);
+  length.writeUInt32LE(valueBuffer.length, 0);
+  return [length, valueBuffer];
+}
+
+// Client for the pre-forking render server built from cplusplus/zygote.cpp.
+// See that file for the wire format.
+export function renderViaZygote(
+  socketPath: string,
+  html: string,
+  width: number,
+  height: number,
+  imagePaths: { [key: string]: string } = {},
+  options: { [key: string]: string } = {}
+): Promise<ZygoteResult> {
+  const parts: Buffer[] = [];
+  const htmlBuffer = Buffer.from(html || "", "utf8");
+  const entries = Object.entries(imagePaths);
+  const optionEntries = Object.entries(options);
+
+  const header = Buffer.alloc(20);
+  header.writeUInt32LE(width, 0);
+  header.writeUInt32LE(height, 4);
+  header.writeUInt32LE(htmlBuffer.length, 8);
+  header.writeUInt32LE(entries.length, 12);
+  header.writeUInt32LE(optionEntries.length, 16);
+  parts.push(header, htmlBuffer);
+
+  for (const [name, filePath] of entries) {
+    parts.push(...sizedString(name), ...sizedString(filePath));
+  }
+  for (const [key, value] of optionEntries) {
+    parts.push(...sizedString(key), ...sizedString(value));
+  }
+
+  return new Promise((resolve, reject) => {
+    const socket = net.createConnection(socketPath);
+    const chunks: Buffer[] = [];
+    let received = 0;
+
+    socket.on("connect", () => {
+      socket.write(Buffer.concat(parts));
+    });
+
+    socket.on("data", (chunk: Buffer) => {
+      chunks.push(chunk);
+      received += chunk.length;
+      if (received < 8) {
+        return;
+      }
+
+      const response = Buffer.concat(chunks);
+      chunks.length = 0;
+      chunks.push(response);
+
+      const status = response.readUInt32LE(0);
+      const length = response.readUInt32LE(4);
+      if (response.length < 8 + length + 4) {
+        return;
+      }
+      const metaLength = response.readUInt32LE(8 + length);
+      const metaStart = 8 + length + 4;
+      if (response.length < metaStart + metaLength) {
+        return;
+      }
+
+      socket.end();
+      const payload = response.subarray(8, 8 + length);
+      if (status !== 0) {
+        reject(new Error(payload.toString("utf8")));
+        return;
+      }
+
+      const meta: { [key: string]: string } = {};
+      for (const line of response.subarray(metaStart, metaStart + metaLength).toString("utf8").split("\n")) {
+        const eq = line.indexOf("=");
+        if (eq > 0) {
+          meta[line.slice(0, eq)] = line.slice(eq + 1);
+        }
+      }
+      resolve({ png: payload, meta });
+    });
+
+    socket.on("error", reject);
+    socket.on("close", () => {
+      reject(new Error("Zygote connection closed before the response"));
+    });
+  });
+}